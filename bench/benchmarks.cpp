@@ -0,0 +1,263 @@
+#include "checks.h"
+#include "game.h"
+#include "harness.h"
+#include "lookup.h"
+#include "match.h"
+#include "mcts.h"
+#include "protocol.h"
+#include "run.h"
+#include "scheduler.h"
+#include "search.h"
+#include "utils.h"
+#include "value.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+extern thread_local uint32_t rng_state;
+
+// Inputs are drawn up front so the timed loops only run the code under test
+constexpr int INPUTS = 4096;
+
+// Searched by the fixed workload, from an opening roll to the last rounds
+static const char* positions[] = {
+    "dice 1 1 4 0 0 0 rerolls 2",
+    "dice 0 2 0 2 0 2 rerolls 1 scores Ones 2 Twos 6 Pair 10",
+    "dice 0 0 0 1 5 0 rerolls 0 scores Sixes 24 ThreeKind 15 Chance 25 House 20",
+    "dice 3 0 0 0 0 3 rerolls 3 scores Ones 3 Twos 6 Threes 9 Fours 12 Fives 15 Sixes 24 Pair 12 TwoPair 22 ThreePair 30 ThreeKind 18",
+    "dice 1 1 1 1 1 1 rerolls 0 scores Ones 3 Twos 6 Threes 9 Fours 12 Fives 15 Sixes 24 Pair 12 TwoPair 22 ThreePair 30 ThreeKind 18 "
+    "FourKind 24 FiveKind 25 Villa 0 Tower 0 Chance 30 MaxiYahtzee 0 House 20",
+};
+
+// Random non-empty sets of open categories
+static std::vector<uint32_t> random_masks() {
+    std::vector<uint32_t> masks(INPUTS);
+    for (auto& mask : masks) {
+        mask = 1 + fast_rand_u32() % ((1 << (int)Category::Count) - 1);
+    }
+    return masks;
+}
+
+template <typename F>
+static std::chrono::nanoseconds time_call(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::steady_clock::now() - start;
+}
+
+static void usage() {
+    std::cerr << "Usage: benchmarks [--format json|csv] [--samples n] [--warmup n] [--filter name] [--baseline file.csv] [--tolerance fraction] [--assert-zero-alloc] [--check]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // Fixed seeds, so every run measures the same inputs
+    rng_state = 1;
+
+    BenchOptions options;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--assert-zero-alloc") {
+            options.assert_zero_alloc = true;
+            continue;
+        }
+        if (arg == "--check") {
+            check = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--format" && (value == "json" || value == "csv")) {
+            options.format = value;
+        } else if (arg == "--samples") {
+            options.samples = std::max(1, std::stoi(value));
+        } else if (arg == "--warmup") {
+            options.warmup = std::max(0, std::stoi(value));
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--baseline") {
+            options.baseline = value;
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::stod(value);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (options.assert_zero_alloc && !allocation_counting) {
+        std::cerr << "Error: --assert-zero-alloc needs a build with ALLOC=1, otherwise nothing is checked" << std::endl;
+        return 1;
+    }
+    BenchRunner runner(options);
+
+    // The init functions log to stdout, which is reserved for the report
+    std::streambuf* stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+    runner.record("init_dice_lookups", time_call(init_dice_lookups));
+    runner.record("init_mask_lookups", time_call(init_mask_lookups));
+    runner.record("init_playout_tables", time_call(init_playout_tables));
+    runner.record("init_completion_values", time_call([] { init_completion_values(); }));
+    runner.record("init_value_table", time_call(init_value_table));
+    std::cout.rdbuf(stdout_buffer);
+
+    if (check) {
+        return run_checks() == 0 ? 0 : 1;
+    }
+
+    // The pool is never resized, so it is sized for the widest search up front
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    Config pool_config;
+    pool_config.threads = max_threads;
+    ensure_pool_exists(pool_config);
+
+    // Dice() rolls all six dice
+    std::vector<Dice> dice(INPUTS);
+    std::vector<uint32_t> masks = random_masks();
+
+    runner.run("get_dice_lookup", [&] {
+        uint64_t sum = 0;
+        for (int i = 0; i < INPUTS; i++) {
+            sum += get_dice_lookup(dice[i]).index;
+        }
+        do_not_optimize(sum);
+        return (int64_t)INPUTS;
+    }, AllocationFree);
+
+    runner.run("get_best_reroll", [&] {
+        uint64_t sum = 0;
+        for (int i = 0; i < INPUTS; i++) {
+            sum += get_best_reroll(dice[i], masks[i]).num_rolls;
+        }
+        do_not_optimize(sum);
+        return (int64_t)INPUTS;
+    }, AllocationFree);
+
+    std::vector<Reroll> rerolls(INPUTS);
+    for (int i = 0; i < INPUTS; i++) {
+        auto& lookup = get_dice_lookup(dice[i]);
+        // DiceLookup::rerolls is never filled, the sorted list holds all 63
+        rerolls[i] = lookup.sorted_rerolls[fast_rand_u32() % lookup.sorted_rerolls.size()];
+    }
+    runner.run("dice_reroll", [&] {
+        uint64_t sum = 0;
+        Dice d = dice[0];
+        for (int i = 0; i < INPUTS; i++) {
+            d.reroll(rerolls[i]);
+            sum += d.dice_freq[0];
+        }
+        do_not_optimize(sum);
+        return (int64_t)INPUTS;
+    }, AllocationFree);
+
+    for (int players : {1, 2}) {
+        // Reset by assignment, which reuses the players' storage, so only
+        // the playout itself is measured
+        Game start(players);
+        Game game = start;
+        runner.run("playout_" + std::to_string(players) + "p", [&] {
+            constexpr int PLAYOUTS = 256;
+            uint64_t sum = 0;
+            for (int i = 0; i < PLAYOUTS; i++) {
+                game = start;
+                game.dice.reroll_all();
+                game.playout();
+                sum += game.players[0].total_score();
+            }
+            do_not_optimize(sum);
+            return (int64_t)PLAYOUTS;
+        }, AllocationFree);
+    }
+
+    // Not AllocationFree: every expansion allocates the new node, its
+    // players and its parent's growing child array
+    Config config;
+    config.games = 1;
+    runner.run("run_iteration", [&] {
+        constexpr int ITERATIONS = 2000;
+        MCTSNode root(Game(1));
+        for (int i = 0; i < ITERATIONS; i++) {
+            root.run_iteration(config);
+        }
+        do_not_optimize(root.visits);
+        return (int64_t)ITERATIONS;
+    });
+
+    // Whole searches with a fixed iteration budget, so ns/op is the latency
+    // of one move and threads only change how fast the budget is spent
+    for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+        config.threads = threads;
+        config.iterations = 20000;
+        runner.run("run_mcts_" + std::to_string(threads) + "t", [&] {
+            Game game(1);
+            Move move = run_mcts(game, config);
+            do_not_optimize((uint64_t)move.type);
+            return (int64_t)1;
+        }, UsesPool);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    // The fixed workload of the regression gate: the same positions searched
+    // for a fixed number of iterations and for a fixed time, and games on
+    // seeded dice whose scores catch changes that trade strength for speed
+    std::vector<Game> games;
+    for (const char* position : positions) {
+        std::istringstream iss(position);
+        games.push_back(parse_position(iss));
+    }
+    Config fixed;
+    fixed.threads = 1;
+    fixed.iterations = 5000;
+    runner.run("search_positions_iterations", [&] {
+        for (Game& game : games) {
+            do_not_optimize((uint64_t)run_mcts(game, fixed).type);
+        }
+        return (int64_t)games.size();
+    }, UsesPool);
+
+    Config timed;
+    timed.threads = 1;
+    timed.ms_per_move = 20;
+    runner.run("search_positions_time", [&] {
+        int64_t total = 0;
+        for (Game& game : games) {
+            SearchInfo info;
+            run_mcts(game, timed, {}, &info);
+            total += info.visits;
+        }
+        return total;
+    }, UsesPool);
+
+    if (runner.selected("seeded_game_score")) {
+        constexpr int GAMES = 16;
+        Config scored;
+        scored.threads = 1;
+        scored.iterations = 200;
+        std::vector<double> scores;
+        // On a worker a single-threaded search runs on the calling thread, so
+        // its random numbers come from the state seeded here rather than from
+        // a lane seeded by thread id. Reseeded per game, the scores don't
+        // depend on what ran before and are the same on every run.
+        TaskGroup group;
+        ensure_pool_exists(scored).submit(
+            [&] {
+                for (int i = 0; i < GAMES; i++) {
+                    rng_state = (i + 1) * 2654435761u;
+                    scores.push_back(play_seeded_game(scored, i + 1));
+                }
+            },
+            group);
+        ensure_pool_exists(scored).wait(group);
+        runner.record_values("seeded_game_score", "points", scores);
+    }
+
+    runner.report();
+    if (!options.baseline.empty()) {
+        return runner.compare() == 0 ? 0 : 1;
+    }
+}
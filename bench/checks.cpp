@@ -0,0 +1,162 @@
+#include "checks.h"
+#include "batch.h"
+#include "corpus.h"
+#include "game.h"
+#include "match.h"
+#include "mcts.h"
+#include "protocol.h"
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Playouts per batch size and kernel, enough for a standard error of the
+// mean score of well under a point
+constexpr int CHECK_PLAYOUTS = 20000;
+
+// Mean and variance of the final scores of full playouts from game
+struct ScoreSample {
+    int64_t count = 0;
+    double sum = 0;
+    double sum_squares = 0;
+
+    void add(double score) {
+        count++;
+        sum += score;
+        sum_squares += score * score;
+    }
+    double mean() const {
+        return sum / count;
+    }
+    double variance() const {
+        return (sum_squares - sum * sum / count) / (count - 1);
+    }
+};
+
+static ScoreSample batch_scores(Game& game, int size, bool simd) {
+    ScoreSample sample;
+    PlayoutBatch batch;
+    for (int played = 0; played < CHECK_PLAYOUTS; played += size) {
+        batch.load(game, size);
+        if (simd) {
+            batch.playout((uint8_t)Category::Count);
+        } else {
+            batch.playout_scalar((uint8_t)Category::Count);
+        }
+        for (int l = 0; l < size; l++) {
+            sample.add(batch.score[l] + (batch.bonus[l] >= 75 ? 50 : 0));
+        }
+    }
+    return sample;
+}
+
+// The AVX2 kernel plays the same policy as the scalar loop on different
+// random numbers, so the mean scores agree within a few standard errors for
+// every batch size, including those that leave SIMD lanes unused
+static bool check_batch_kernels() {
+    if (!__builtin_cpu_supports("avx2")) {
+        std::cerr << "check batch_kernels: no AVX2, skipped" << std::endl;
+        return true;
+    }
+    bool ok = true;
+    Game game(1);
+    game.dice = Dice({1, 1, 4, 0, 0, 0});
+    for (int size = 1; size <= 9; size++) {
+        ScoreSample scalar = batch_scores(game, size, false);
+        ScoreSample simd = batch_scores(game, size, true);
+        double se = std::sqrt(scalar.variance() / scalar.count + simd.variance() / simd.count);
+        if (std::abs(scalar.mean() - simd.mean()) > 4 * se) {
+            std::cerr << "check batch_kernels: size " << size << " scalar mean " << scalar.mean() << " AVX2 mean " << simd.mean() << " differ by more than 4 * " << se << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Every position reached by Game::play_move, written as a position command
+// and parsed back, is the same state, and a category can't be scored twice
+static bool check_position_round_trip() {
+    bool ok = true;
+    for (Game& game : seeded_positions(1, 48)) {
+        std::string position = position_string(game);
+        std::istringstream iss(position);
+        if (!(parse_position(iss) == game)) {
+            std::cerr << "check position_round_trip: " << position << " parses to a different state" << std::endl;
+            ok = false;
+        }
+    }
+    try {
+        std::istringstream iss("dice 1 1 1 1 1 1 scores Ones 1 Ones 2");
+        parse_position(iss);
+        std::cerr << "check position_round_trip: a category scored twice was accepted" << std::endl;
+        ok = false;
+    } catch (std::invalid_argument const&) {
+    }
+    return ok;
+}
+
+// A corpus read back holds the positions and reference moves it was written
+// with, so agreement and loss are measured on the searched states
+static bool check_corpus_round_trip() {
+    Config config;
+    config.threads = 1;
+    config.iterations = 100;
+    std::vector<CorpusEntry> entries;
+    for (Game& game : seeded_positions(2, 24)) {
+        SearchInfo info;
+        run_mcts(game, config, {}, &info);
+        entries.push_back({game, std::move(info.children)});
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "maxi-yahtzee-check.corpus").string();
+    if (!write_corpus(path, entries)) {
+        std::cerr << "check corpus_round_trip: cannot write " << path << std::endl;
+        return false;
+    }
+    std::vector<CorpusEntry> read;
+    try {
+        read = read_corpus(path);
+    } catch (...) {
+        std::filesystem::remove(path);
+        throw;
+    }
+    std::filesystem::remove(path);
+    bool ok = read.size() == entries.size();
+    for (size_t i = 0; ok && i < entries.size(); i++) {
+        bool same_reference = read[i].reference.size() == entries[i].reference.size();
+        for (size_t j = 0; same_reference && j < entries[i].reference.size(); j++) {
+            ChildStats const& a = read[i].reference[j];
+            ChildStats const& b = entries[i].reference[j];
+            same_reference = a.move == b.move && a.visits == b.visits && a.total_score == b.total_score;
+        }
+        if (!(read[i].game == entries[i].game) || !same_reference) {
+            std::cerr << "check corpus_round_trip: entry " << i << " differs: " << position_string(entries[i].game) << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int run_checks() {
+    const std::vector<std::pair<const char*, std::function<bool()>>> checks = {
+        {"batch_kernels", check_batch_kernels},
+        {"position_round_trip", check_position_round_trip},
+        {"corpus_round_trip", check_corpus_round_trip},
+    };
+    int failed = 0;
+    for (auto& [name, check] : checks) {
+        bool ok;
+        try {
+            ok = check();
+        } catch (std::exception const& e) {
+            std::cerr << "check " << name << ": " << e.what() << std::endl;
+            ok = false;
+        }
+        failed += !ok;
+        std::cerr << "check " << name << ": " << (ok ? "ok" : "FAILED") << std::endl;
+    }
+    std::cerr << failed << " of " << checks.size() << " checks failed" << std::endl;
+    return failed;
+}
@@ -0,0 +1,9 @@
+#ifndef BENCH_CHECKS_HPP
+#define BENCH_CHECKS_HPP
+
+// Consistency checks of the engine, run with --check once the tables are
+// loaded. Every failure is printed to stderr; returns the number of failed
+// checks.
+int run_checks();
+
+#endif // BENCH_CHECKS_HPP
@@ -0,0 +1,277 @@
+#include "harness.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+
+static volatile uint64_t sink;
+
+void do_not_optimize(uint64_t value) {
+    sink = sink + value;
+}
+
+bool BenchResult::higher_is_better() const {
+    return unit != "ns/op";
+}
+
+double BenchResult::percentile(double p) const {
+    if (values.empty()) {
+        return 0;
+    }
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5))];
+}
+
+double BenchResult::median() const {
+    return percentile(0.5);
+}
+
+double BenchResult::mean() const {
+    return values.empty() ? 0 : std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+double BenchResult::min() const {
+    return values.empty() ? 0 : *std::min_element(values.begin(), values.end());
+}
+
+double BenchResult::stddev() const {
+    if (values.size() < 2) {
+        return 0;
+    }
+    double m = mean();
+    double sum = 0;
+    for (double v : values) {
+        sum += (v - m) * (v - m);
+    }
+    return std::sqrt(sum / (values.size() - 1));
+}
+
+double BenchResult::ops_per_sec() const {
+    double ns = median();
+    return ns > 0 && !higher_is_better() ? 1e9 / ns : 0;
+}
+
+double BenchResult::per_op(PerfCounters::Event event) const {
+    return counted_ops ? (double)counters[event] / counted_ops : 0;
+}
+
+double BenchResult::allocations_per_op() const {
+    return counted_ops ? (double)allocations.allocations / counted_ops : 0;
+}
+
+double BenchResult::alloc_bytes_per_op() const {
+    return counted_ops ? (double)allocations.bytes / counted_ops : 0;
+}
+
+double BenchResult::ipc() const {
+    return counters[PerfCounters::Cycles] ? (double)counters[PerfCounters::Instructions] / counters[PerfCounters::Cycles] : 0;
+}
+
+BenchRunner::BenchRunner(BenchOptions options)
+    : options(options) {
+    if (!counters.available()) {
+        std::cerr << "Hardware counters unavailable (" << counters.error() << "), reporting timings only" << std::endl;
+    }
+}
+
+bool BenchRunner::selected(const std::string& name) const {
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+void BenchRunner::run(const std::string& name, BenchBody const& body, unsigned flags) {
+    if (!selected(name)) {
+        return;
+    }
+    std::cerr << "bench " << name << std::flush;
+    for (int i = 0; i < options.warmup; i++) {
+        body();
+    }
+    BenchResult result;
+    result.name = name;
+    result.has_counters = counters.available() && !(flags & UsesPool);
+    // Pool workers allocate on behalf of the body, so count every thread
+    auto allocated_so_far = (flags & UsesPool) ? all_allocations : thread_allocations;
+    for (int i = 0; i < options.samples; i++) {
+        AllocationCounts allocations = allocated_so_far();
+        counters.start();
+        auto start = std::chrono::steady_clock::now();
+        int64_t ops;
+        if ((flags & AllocationFree) && options.assert_zero_alloc) {
+            NoAllocationScope no_allocations;
+            ops = body();
+        } else {
+            ops = body();
+        }
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        PerfCounters::Values counts = counters.stop();
+        AllocationCounts allocated = allocated_so_far() - allocations;
+        result.allocations.allocations += allocated.allocations;
+        result.allocations.bytes += allocated.bytes;
+        for (int event = 0; event < PerfCounters::Count; event++) {
+            result.counters[event] += counts[event];
+        }
+        result.counted_ops += ops;
+        result.ops_per_sample = ops;
+        result.values.push_back((double)elapsed.count() / std::max<int64_t>(ops, 1));
+    }
+    std::cerr << ": " << result.median() << " ns/op" << std::endl;
+    results.push_back(result);
+}
+
+void BenchRunner::record(const std::string& name, std::chrono::nanoseconds elapsed, int64_t ops) {
+    if (!selected(name)) {
+        return;
+    }
+    BenchResult result;
+    result.name = name;
+    result.ops_per_sample = ops;
+    result.values.push_back((double)elapsed.count() / ops);
+    results.push_back(result);
+}
+
+void BenchRunner::record_values(const std::string& name, const std::string& unit, std::vector<double> values) {
+    if (!selected(name)) {
+        return;
+    }
+    BenchResult result;
+    result.name = name;
+    result.unit = unit;
+    result.ops_per_sample = values.size();
+    result.values = std::move(values);
+    results.push_back(result);
+}
+
+void BenchRunner::report() const {
+    std::cout << std::fixed << std::setprecision(2);
+    if (options.format == "csv") {
+        std::cout << "name,unit,samples,ops_per_sample,median,mean,min,p90,stddev,ops_per_sec,ipc,instructions_per_op,cache_misses_per_op,tlb_misses_per_op,branch_misses_per_op,allocations_per_op,alloc_bytes_per_op\n";
+        for (auto& r : results) {
+            std::cout << r.name << "," << r.unit << "," << r.values.size() << "," << r.ops_per_sample << "," << r.median() << "," << r.mean() << "," << r.min() << "," << r.percentile(0.9) << ","
+                      << r.stddev() << "," << r.ops_per_sec();
+            if (r.has_counters) {
+                std::cout << "," << r.ipc() << "," << r.per_op(PerfCounters::Instructions) << "," << r.per_op(PerfCounters::CacheMisses) << "," << r.per_op(PerfCounters::TlbMisses) << ","
+                          << r.per_op(PerfCounters::BranchMisses);
+            } else {
+                std::cout << ",,,,,";
+            }
+            if (allocation_counting) {
+                std::cout << "," << r.allocations_per_op() << "," << r.alloc_bytes_per_op();
+            } else {
+                std::cout << ",,";
+            }
+            std::cout << "\n";
+        }
+        return;
+    }
+    std::cout << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        std::cout << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"samples\": " << r.values.size() << ", \"ops_per_sample\": " << r.ops_per_sample
+                  << ", \"values\": {\"median\": " << r.median() << ", \"mean\": " << r.mean() << ", \"min\": " << r.min() << ", \"p90\": " << r.percentile(0.9) << ", \"stddev\": " << r.stddev()
+                  << "}, \"ops_per_sec\": " << r.ops_per_sec();
+        if (r.has_counters) {
+            std::cout << ", \"counters\": {\"ipc\": " << r.ipc() << ", \"instructions_per_op\": " << r.per_op(PerfCounters::Instructions) << ", \"cache_misses_per_op\": "
+                      << r.per_op(PerfCounters::CacheMisses) << ", \"tlb_misses_per_op\": " << r.per_op(PerfCounters::TlbMisses) << ", \"branch_misses_per_op\": " << r.per_op(PerfCounters::BranchMisses)
+                      << "}";
+        }
+        if (allocation_counting) {
+            std::cout << ", \"allocations_per_op\": " << r.allocations_per_op() << ", \"alloc_bytes_per_op\": " << r.alloc_bytes_per_op();
+        }
+        std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}" << std::endl;
+}
+
+// The summary columns of a row of the CSV report
+struct BaselineRow {
+    std::string unit;
+    double samples, median, mean, min, p90, stddev;
+};
+
+static bool read_baseline(const std::string& path, std::map<std::string, BaselineRow>& rows) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        return false;
+    }
+    std::string line;
+    std::getline(ifs, line);
+    if (line.rfind("name,unit,", 0) != 0) {
+        return false;
+    }
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        std::string name, unit, field;
+        std::vector<double> fields;
+        std::getline(iss, name, ',');
+        std::getline(iss, unit, ',');
+        // The counter columns after these may be empty
+        while (fields.size() < 8 && std::getline(iss, field, ',')) {
+            fields.push_back(std::stod(field));
+        }
+        if (fields.size() < 8) {
+            return false;
+        }
+        // fields[1] is ops_per_sample
+        rows[name] = {unit, fields[0], fields[2], fields[3], fields[4], fields[5], fields[6]};
+    }
+    return true;
+}
+
+int BenchRunner::compare() const {
+    std::map<std::string, BaselineRow> baseline;
+    if (!read_baseline(options.baseline, baseline)) {
+        std::cerr << "Error: cannot read baseline " << options.baseline << ", create one with: benchmarks --format csv > " << options.baseline << std::endl;
+        return -1;
+    }
+
+    int regressions = 0;
+    int changes = 0;
+    std::cerr << std::fixed << std::setprecision(2);
+    for (auto& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            std::cerr << "regress " << r.name << ": not in the baseline" << std::endl;
+            continue;
+        }
+        BaselineRow const& base = it->second;
+        // One-off timings, e.g. table init, depend on the page cache and on
+        // shared segments left by other runs
+        if (r.values.size() < 2 || base.samples < 2) {
+            std::cerr << "regress " << r.name << ": single sample, skipped" << std::endl;
+            continue;
+        }
+        if (r.higher_is_better()) {
+            // Values, e.g. the scores of seeded games, are deterministic, so
+            // any change means the engine plays differently. Compared at the
+            // precision of the report; only a lower mean is a regression,
+            // other changes are reported so the baseline can be refreshed.
+            auto same = [](double now, double then) {
+                return std::abs(std::round(now * 100) - std::round(then * 100)) < 0.5;
+            };
+            bool changed = !same(r.values.size(), base.samples) || !same(r.mean(), base.mean) || !same(r.median(), base.median) || !same(r.min(), base.min) ||
+                           !same(r.percentile(0.9), base.p90) || !same(r.stddev(), base.stddev);
+            bool worse = std::round(r.mean() * 100) < std::round(base.mean * 100);
+            regressions += worse;
+            changes += changed && !worse;
+            std::cerr << "regress " << r.name << ": base " << base.mean << " now " << r.mean() << " " << r.unit << " "
+                      << (worse ? "REGRESSION" : changed ? "changed, refresh the baseline if the engine is meant to play differently" : "ok") << std::endl;
+            continue;
+        }
+        // Timings: the slowdown of the median must exceed the tolerance and
+        // the spread of the baseline. The current run's spread is left out,
+        // as a noisy regressed run would widen its own margin.
+        double change = r.median() / base.median - 1;
+        double margin = std::max(options.tolerance, (base.p90 - base.min) / base.median);
+        bool regressed = change > margin;
+        regressions += regressed;
+        std::cerr << "regress " << r.name << ": base " << base.median << " now " << r.median() << " " << r.unit
+                  << " worse by " << 100 * change << "% margin " << 100 * margin << "% " << (regressed ? "REGRESSION" : change < -margin ? "improved" : "ok") << std::endl;
+    }
+    std::cerr << regressions << " regressions, " << changes << " changed values against " << options.baseline << std::endl;
+    return regressions;
+}
@@ -0,0 +1,99 @@
+#ifndef BENCH_HARNESS_HPP
+#define BENCH_HARNESS_HPP
+
+#include "allocations.h"
+#include "perf_counters.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+    int warmup = 2;
+    int samples = 10;
+    // Only benchmarks whose name contains this run
+    std::string filter;
+    std::string format = "json";
+    // Baseline to compare against, a previous run's CSV output
+    std::string baseline;
+    // Smallest relative slowdown counted as a regression, noisier
+    // benchmarks get a wider margin
+    double tolerance = 0.05;
+    // Abort when a benchmark declared allocation free allocates (ALLOC=1)
+    bool assert_zero_alloc = false;
+};
+
+// One benchmark's samples: nanoseconds per operation for timings, or e.g.
+// the scores of seeded games, where higher is better
+struct BenchResult {
+    std::string name;
+    std::string unit = "ns/op";
+    int64_t ops_per_sample = 0;
+    std::vector<double> values;
+    // Hardware counters summed over the samples, when available
+    bool has_counters = false;
+    PerfCounters::Values counters{};
+    int64_t counted_ops = 0;
+    // Heap allocations of the samples, with ALLOC=1
+    AllocationCounts allocations;
+
+    bool higher_is_better() const;
+    double median() const;
+    double mean() const;
+    double min() const;
+    double percentile(double p) const;
+    double stddev() const;
+    double ops_per_sec() const;
+    // Counter per operation, e.g. cache misses per playout
+    double per_op(PerfCounters::Event event) const;
+    double ipc() const;
+    double allocations_per_op() const;
+    double alloc_bytes_per_op() const;
+};
+
+// A sample runs body once; body returns how many operations it did
+using BenchBody = std::function<int64_t()>;
+
+enum BenchFlags : unsigned {
+    // Checked with --assert-zero-alloc
+    AllocationFree = 1,
+    // The work runs on the search pool, where the calling thread's hardware
+    // counters don't see it, so none are reported, and allocations are
+    // counted over every thread
+    UsesPool = 2,
+};
+
+class BenchRunner {
+public:
+    explicit BenchRunner(BenchOptions options);
+
+    bool selected(const std::string& name) const;
+    // Runs the warmup, then the samples, unless the filter excludes name.
+    // flags are BenchFlags; the samples of an AllocationFree benchmark run in
+    // a NoAllocationScope with --assert-zero-alloc.
+    void run(const std::string& name, BenchBody const& body, unsigned flags = 0);
+    // Records a one-off measurement, e.g. table init, as a single sample
+    void record(const std::string& name, std::chrono::nanoseconds elapsed, int64_t ops = 1);
+    // Records values that aren't timings, e.g. scores
+    void record_values(const std::string& name, const std::string& unit, std::vector<double> values);
+    // Writes every result in the chosen format to stdout
+    void report() const;
+    // Compares the results with options.baseline and prints a verdict per
+    // benchmark to stderr: timings regress when they slow down beyond the
+    // tolerance and the baseline's spread, values when their mean drops.
+    // Values that change without getting worse are reported, not counted.
+    // Returns the number of regressions, or -1 when the baseline can't be
+    // read.
+    int compare() const;
+
+private:
+    BenchOptions options;
+    std::vector<BenchResult> results;
+    PerfCounters counters;
+};
+
+// Keeps the compiler from dropping a benchmarked computation
+void do_not_optimize(uint64_t value);
+
+#endif // BENCH_HARNESS_HPP
@@ -0,0 +1,82 @@
+#include "perf_counters.h"
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int open_event(uint32_t type, uint64_t config, int group_fd) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    // Only the leader starts disabled, the members follow it
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+PerfCounters::PerfCounters() {
+    fds.fill(-1);
+    constexpr uint64_t tlb_read_miss = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    const std::array<std::pair<uint32_t, uint64_t>, Count> events = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HW_CACHE, tlb_read_miss},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    }};
+    for (int i = 0; i < Count; i++) {
+        fds[i] = open_event(events[i].first, events[i].second, fds[0]);
+        if (fds[i] < 0) {
+            reason = std::strerror(errno);
+            return;
+        }
+    }
+    ok = true;
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool PerfCounters::available() const {
+    return ok;
+}
+
+const std::string& PerfCounters::error() const {
+    return reason;
+}
+
+void PerfCounters::start() {
+    if (!ok) {
+        return;
+    }
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::Values PerfCounters::stop() {
+    Values values{};
+    if (!ok) {
+        return values;
+    }
+    ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // nr, time_enabled, time_running, then one value per event
+    uint64_t buffer[3 + Count];
+    if (read(fds[0], buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer) || buffer[2] == 0) {
+        return values;
+    }
+    double scale = (double)buffer[1] / buffer[2];
+    for (int i = 0; i < Count; i++) {
+        values[i] = buffer[3 + i] * scale;
+    }
+    return values;
+}
@@ -0,0 +1,36 @@
+#ifndef BENCH_PERF_COUNTERS_HPP
+#define BENCH_PERF_COUNTERS_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Hardware counters of the calling thread, user space only, read through
+// perf_event_open. Work done by other threads, e.g. the pool workers of any
+// search started with run_mcts, isn't counted.
+class PerfCounters {
+public:
+    enum Event { Cycles, Instructions, CacheMisses, TlbMisses, BranchMisses, Count };
+    using Values = std::array<uint64_t, Count>;
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // False when the kernel or the hypervisor doesn't expose the counters,
+    // or perf_event_paranoid forbids them; start and stop then do nothing
+    bool available() const;
+    // Why the counters are unavailable
+    const std::string& error() const;
+    void start();
+    // Counts since start, scaled up when the kernel multiplexed the group
+    Values stop();
+
+private:
+    std::array<int, Count> fds;
+    bool ok = false;
+    std::string reason;
+};
+
+#endif // BENCH_PERF_COUNTERS_HPP
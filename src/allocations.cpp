@@ -0,0 +1,160 @@
+#include "allocations.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Threads with counters of their own, later threads share the last slot
+constexpr int MAX_COUNTED_THREADS = 1024;
+
+struct alignas(64) ThreadAllocations {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+// Constant initialized, so allocations made before main are counted too.
+// Nothing here may allocate.
+static ThreadAllocations slots[MAX_COUNTED_THREADS];
+static std::atomic<int> slots_used{0};
+static thread_local ThreadAllocations* slot = nullptr;
+static thread_local int forbidden = 0;
+
+static ThreadAllocations& thread_slot() {
+    if (!slot) {
+        int i = slots_used.fetch_add(1, std::memory_order_relaxed);
+        slot = &slots[i < MAX_COUNTED_THREADS ? i : MAX_COUNTED_THREADS - 1];
+    }
+    return *slot;
+}
+
+static void* counted_alloc(std::size_t size, std::size_t alignment, bool nothrow) {
+    if (forbidden > 0) {
+        forbidden = 0;
+        std::fputs("Allocation in a NoAllocationScope\n", stderr);
+        std::abort();
+    }
+    ThreadAllocations& counts = thread_slot();
+    counts.allocations.fetch_add(1, std::memory_order_relaxed);
+    counts.bytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (size == 0) {
+        size = 1;
+    }
+    void* p;
+    if (alignment <= alignof(std::max_align_t)) {
+        p = std::malloc(size);
+    } else {
+        // aligned_alloc wants a multiple of the alignment
+        p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+    if (!p && !nothrow) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(std::size_t size) {
+    return counted_alloc(size, 0, false);
+}
+void* operator new[](std::size_t size) {
+    return counted_alloc(size, 0, false);
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return counted_alloc(size, (std::size_t)alignment, false);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return counted_alloc(size, (std::size_t)alignment, false);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, 0, true);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, 0, true);
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, (std::size_t)alignment, true);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, (std::size_t)alignment, true);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+AllocationCounts thread_allocations() {
+    ThreadAllocations& counts = thread_slot();
+    return {counts.allocations.load(std::memory_order_relaxed), counts.bytes.load(std::memory_order_relaxed)};
+}
+
+AllocationCounts all_allocations() {
+    AllocationCounts total;
+    int used = std::min(slots_used.load(std::memory_order_relaxed), MAX_COUNTED_THREADS);
+    for (int i = 0; i < used; i++) {
+        total.allocations += slots[i].allocations.load(std::memory_order_relaxed);
+        total.bytes += slots[i].bytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+NoAllocationScope::NoAllocationScope() {
+    forbidden++;
+}
+
+NoAllocationScope::~NoAllocationScope() {
+    forbidden--;
+}
+
+#else
+
+AllocationCounts thread_allocations() {
+    return {};
+}
+
+AllocationCounts all_allocations() {
+    return {};
+}
+
+NoAllocationScope::NoAllocationScope() {}
+
+NoAllocationScope::~NoAllocationScope() {}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef ALLOCATIONS_HPP
+#define ALLOCATIONS_HPP
+
+#include <cstdint>
+
+// Heap allocation accounting. Build with ALLOC=1 to replace the global
+// operator new and delete with counting versions, otherwise every count is
+// zero and NoAllocationScope does nothing. Not compatible with DEBUG=1, the
+// address sanitizer replaces them too.
+#ifdef COUNT_ALLOCATIONS
+constexpr bool allocation_counting = true;
+#else
+constexpr bool allocation_counting = false;
+#endif
+
+struct AllocationCounts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    AllocationCounts operator-(AllocationCounts const& other) const {
+        return {allocations - other.allocations, bytes - other.bytes};
+    }
+};
+
+// Allocations made by the calling thread
+AllocationCounts thread_allocations();
+// Summed over every thread
+AllocationCounts all_allocations();
+
+// Asserts that the calling thread doesn't allocate while it is alive: the
+// first allocation prints a message and aborts, so a debugger stops at the
+// culprit. Scopes nest.
+class NoAllocationScope {
+public:
+    NoAllocationScope();
+    ~NoAllocationScope();
+    NoAllocationScope(const NoAllocationScope&) = delete;
+    NoAllocationScope& operator=(const NoAllocationScope&) = delete;
+};
+
+#endif // ALLOCATIONS_HPP
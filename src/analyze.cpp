@@ -0,0 +1,107 @@
+#include "analyze.h"
+#include "protocol.h"
+#include "scheduler.h"
+#include "search.h"
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+extern thread_local uint32_t rng_state;
+
+// Positions in flight per worker; bounds memory when streaming large files
+constexpr int ANALYSIS_WINDOW = 4;
+
+static std::string analyze_position(int64_t index, Game game, Config const& config) {
+    std::ostringstream oss;
+    oss << "position " << index;
+    if (game.is_terminal()) {
+        oss << " bestmove none\n";
+        return oss.str();
+    }
+
+    SearchHandle search(game, config);
+    search.run();
+    SearchInfo info = search.info();
+
+    oss << " visits " << info.visits << " bestmove " << info.best_move().value().to_string() << "\n";
+    for (ChildStats child : info.children) {
+        oss << "child " << child.visits << " " << std::fixed << std::setprecision(3) << child.average_score() << " " << child.move.to_string() << "\n";
+    }
+    return oss.str();
+}
+
+void run_analysis(Config config, std::istream& in) {
+    Scheduler& pool = ensure_pool_exists(config);
+    Config search_config = config;
+    search_config.threads = 1;
+    search_config.ponder = false;
+
+    std::mutex mutex;
+    std::condition_variable ready_cv;
+    std::map<int64_t, std::string> results;
+    int64_t submitted = 0;
+    int64_t printed = 0;
+
+    // Prints finished results in order, waiting until at most max_pending
+    // positions are still outstanding
+    auto drain = [&](int64_t max_pending) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (submitted - printed > max_pending || (!results.empty() && results.begin()->first == printed)) {
+            ready_cv.wait(lock, [&] {
+                return !results.empty() && results.begin()->first == printed;
+            });
+            std::cout << results.begin()->second;
+            results.erase(results.begin());
+            printed++;
+        }
+        std::cout.flush();
+    };
+
+    TaskGroup group;
+    auto start = std::chrono::steady_clock::now();
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string first;
+        if (!(iss >> first)) {
+            continue;
+        }
+        if (first != "position") {
+            iss.clear();
+            iss.seekg(0);
+        }
+
+        int64_t index = submitted++;
+        std::optional<Game> game;
+        try {
+            game = parse_position(iss);
+        } catch (std::exception const& e) {
+            std::lock_guard<std::mutex> lock(mutex);
+            results[index] = "position " + std::to_string(index) + " error " + e.what() + "\n";
+            ready_cv.notify_one();
+        }
+        if (game) {
+            pool.submit(
+                [&, index, game = *game]() {
+                    rng_state = std::hash<std::thread::id>{}(std::this_thread::get_id()) ^ (index * 2654435761u);
+                    std::string result = analyze_position(index, game, search_config);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results[index] = result;
+                    ready_cv.notify_one();
+                },
+                group);
+        }
+        drain(ANALYSIS_WINDOW * pool.size());
+    }
+    drain(0);
+    pool.wait(group);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << submitted << " positions in " << seconds << " s = " << submitted / seconds << " positions/sec" << std::endl;
+}
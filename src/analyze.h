@@ -0,0 +1,14 @@
+#ifndef ANALYZE_HPP
+#define ANALYZE_HPP
+
+#include "run.h"
+#include <istream>
+
+// Analyses one position per line, in the format of the protocol's position
+// command (the "position" keyword is optional, # starts a comment). Every
+// position is a single-threaded search with the config's time or iteration
+// budget, run in parallel on the pool; results are written in input order
+// as soon as they are ready.
+void run_analysis(Config config, std::istream& in);
+
+#endif // ANALYZE_HPP
@@ -0,0 +1,275 @@
+#include "batch.h"
+#include "game.h"
+#include "lookup.h"
+#include "utils.h"
+#include "value.h"
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+static const uint32_t POW7[6] = {1, 7, 49, 343, 2401, 16807};
+
+static inline uint32_t lane_rand(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static inline uint32_t lane_roll(uint32_t& state, int num_rolls) {
+    uint32_t index = 0;
+    for (int i = 0; i < num_rolls; i++) {
+        index += POW7[((lane_rand(state) & 0xFFFF) * 6) >> 16];
+    }
+    return index;
+}
+
+// Successive outputs of the thread's xorshift are its own later states, so
+// lanes seeded with them directly would replay shifted copies of each other
+// and of the previous batch. Scrambled, every lane starts at an unrelated
+// point of the sequence.
+static inline uint32_t lane_seed() {
+    uint32_t x = fast_rand_u32();
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x | 1;
+}
+
+void PlayoutBatch::load(Game& game, int size) {
+    this->size = size;
+    Player& player = game.player();
+    uint32_t dice_index = freq_to_index(game.dice.dice_freq);
+    uint32_t points = 0;
+    for (auto& s : player.scores) {
+        points += s.value_or(0);
+    }
+    for (int l = 0; l < size; l++) {
+        dice[l] = dice_index;
+        open[l] = player.scored_mask;
+        bonus[l] = player.bonus_progress;
+        rerolls[l] = player.rerolls;
+        score[l] = points;
+        rounds[l] = game.rounds;
+        rng[l] = lane_seed();
+    }
+    // Pad the last group of SIMD lanes with finished copies of the first
+    // lane: the kernel gathers table entries for every lane, so the padding
+    // must hold a valid state, and total_score never reads it
+    for (int l = size; l < (size + 7) / 8 * 8; l++) {
+        dice[l] = dice[0];
+        open[l] = open[0];
+        bonus[l] = bonus[0];
+        rerolls[l] = rerolls[0];
+        score[l] = score[0];
+        rounds[l] = (uint32_t)Category::Count;
+        rng[l] = 1;
+    }
+}
+
+__attribute__((target("avx2"))) static inline __m256i next_rand_avx2(__m256i& rng) {
+    rng = _mm256_xor_si256(rng, _mm256_slli_epi32(rng, 13));
+    rng = _mm256_xor_si256(rng, _mm256_srli_epi32(rng, 17));
+    rng = _mm256_xor_si256(rng, _mm256_slli_epi32(rng, 5));
+    return rng;
+}
+
+// Same policy as PlayoutBatch::playout on 8 lanes at a time. Every branch of
+// the policy is computed for all lanes and blended, and the per-dice data is
+// gathered from playout_tables.
+__attribute__((target("avx2"))) static void playout_avx2(PlayoutBatch& batch, int offset, uint8_t max_rounds) {
+    const PlayoutTables& t = *local_playout_tables;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i byte = _mm256_set1_epi32(0xFF);
+    const __m256i pow7 = _mm256_setr_epi32(1, 7, 49, 343, 2401, 16807, 0, 0);
+    const __m256i chunk = _mm256_set1_epi32(127);
+    const __m256i last_upper = _mm256_set1_epi32((int)Category::Sixes);
+    const __m256i end = _mm256_set1_epi32(max_rounds);
+    const int* dice_rank = (const int*)t.dice_rank.data();
+    const int* categories = (const int*)t.categories.data();
+    const int* positions = (const int*)t.positions.data();
+    const int* cross_category = (const int*)t.cross_category.data();
+
+    __m256i dice = _mm256_load_si256((const __m256i*)&batch.dice[offset]);
+    __m256i open = _mm256_load_si256((const __m256i*)&batch.open[offset]);
+    __m256i bonus = _mm256_load_si256((const __m256i*)&batch.bonus[offset]);
+    __m256i rerolls = _mm256_load_si256((const __m256i*)&batch.rerolls[offset]);
+    __m256i score = _mm256_load_si256((const __m256i*)&batch.score[offset]);
+    __m256i rounds = _mm256_load_si256((const __m256i*)&batch.rounds[offset]);
+    __m256i rng = _mm256_load_si256((const __m256i*)&batch.rng[offset]);
+
+    while (true) {
+        __m256i active = _mm256_cmpgt_epi32(end, rounds);
+        if (_mm256_testz_si256(active, active)) {
+            break;
+        }
+
+        __m256i rank = _mm256_i32gather_epi32(dice_rank, dice, 4);
+        __m256i range = _mm256_i32gather_epi32((const int*)t.start_range.data(), rank, 4);
+        __m256i combined = _mm256_and_si256(_mm256_i32gather_epi32((const int*)t.category_mask.data(), rank, 4), open);
+
+        // Score the first open category at or after a random start, on a coin flip
+        __m256i r = next_rand_avx2(rng);
+        __m256i coin = _mm256_cmpeq_epi32(_mm256_and_si256(r, one), one);
+        __m256i start = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(r, 8), byte), range), 8);
+        __m256i chunks = _mm256_mullo_epi32(rank, _mm256_set1_epi32(3 * 128));
+        __m256i valid = _mm256_i32gather_epi32(positions, _mm256_add_epi32(chunks, _mm256_and_si256(combined, chunk)), 2);
+        chunks = _mm256_add_epi32(chunks, _mm256_set1_epi32(128));
+        valid = _mm256_or_si256(valid, _mm256_i32gather_epi32(positions, _mm256_add_epi32(chunks, _mm256_and_si256(_mm256_srli_epi32(combined, 7), chunk)), 2));
+        chunks = _mm256_add_epi32(chunks, _mm256_set1_epi32(128));
+        valid = _mm256_or_si256(valid, _mm256_i32gather_epi32(positions, _mm256_add_epi32(chunks, _mm256_srli_epi32(combined, 14)), 2));
+        valid = _mm256_and_si256(_mm256_and_si256(valid, _mm256_set1_epi32(0xFFFF)), _mm256_sllv_epi32(_mm256_set1_epi32(-1), start));
+        __m256i found = _mm256_xor_si256(_mm256_cmpeq_epi32(valid, zero), _mm256_set1_epi32(-1));
+        // Index of the lowest valid position, read from the exponent of its float value
+        __m256i lowest = _mm256_and_si256(valid, _mm256_sub_epi32(zero, valid));
+        __m256i position = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(lowest)), 23), _mm256_set1_epi32(127));
+        position = _mm256_and_si256(position, found);
+        __m256i entry = _mm256_i32gather_epi32(categories, _mm256_add_epi32(_mm256_slli_epi32(rank, 4), position), 4);
+        __m256i scored = _mm256_and_si256(_mm256_and_si256(active, coin), found);
+        __m256i category = _mm256_and_si256(entry, byte);
+        __m256i points = _mm256_and_si256(_mm256_srli_epi32(entry, 8), scored);
+        __m256i upper = _mm256_andnot_si256(_mm256_cmpgt_epi32(category, last_upper), scored);
+        open = _mm256_xor_si256(open, _mm256_and_si256(_mm256_sllv_epi32(one, category), scored));
+        score = _mm256_add_epi32(score, points);
+        bonus = _mm256_add_epi32(bonus, _mm256_and_si256(points, upper));
+
+        // Otherwise reroll, or cross the worst open category when out of rerolls
+        __m256i rest = _mm256_andnot_si256(scored, active);
+        __m256i reroll = _mm256_andnot_si256(_mm256_cmpeq_epi32(rerolls, zero), rest);
+        __m256i cross = _mm256_andnot_si256(reroll, rest);
+        __m256i worst = _mm256_and_si256(_mm256_i32gather_epi32(cross_category, open, 1), byte);
+        worst = _mm256_sllv_epi32(one, worst);
+        open = _mm256_xor_si256(open, _mm256_and_si256(worst, cross));
+        rerolls = _mm256_add_epi32(rerolls, reroll);
+
+        __m256i turn_over = _mm256_or_si256(scored, cross);
+        rounds = _mm256_sub_epi32(rounds, turn_over);
+        rerolls = _mm256_add_epi32(rerolls, _mm256_and_si256(turn_over, _mm256_set1_epi32(2)));
+
+        // Rerolled lanes roll onto the held dice, lanes starting a new turn roll all six
+        __m256i hold = _mm256_i32gather_epi32((const int*)t.reroll_hold.data(), rank, 4);
+        __m256i num_rolls = _mm256_and_si256(_mm256_i32gather_epi32((const int*)t.reroll_count.data(), rank, 4), reroll);
+        dice = _mm256_andnot_si256(turn_over, _mm256_blendv_epi8(dice, hold, reroll));
+        num_rolls = _mm256_blendv_epi8(num_rolls, _mm256_set1_epi32(6), turn_over);
+        for (int k = 0; k < 6; k++) {
+            __m256i roll = _mm256_and_si256(next_rand_avx2(rng), _mm256_set1_epi32(0xFFFF));
+            __m256i face = _mm256_srli_epi32(_mm256_mullo_epi32(roll, _mm256_set1_epi32(6)), 16);
+            __m256i digit = _mm256_permutevar8x32_epi32(pow7, face);
+            dice = _mm256_add_epi32(dice, _mm256_and_si256(digit, _mm256_cmpgt_epi32(num_rolls, _mm256_set1_epi32(k))));
+        }
+    }
+
+    _mm256_store_si256((__m256i*)&batch.dice[offset], dice);
+    _mm256_store_si256((__m256i*)&batch.open[offset], open);
+    _mm256_store_si256((__m256i*)&batch.bonus[offset], bonus);
+    _mm256_store_si256((__m256i*)&batch.rerolls[offset], rerolls);
+    _mm256_store_si256((__m256i*)&batch.score[offset], score);
+    _mm256_store_si256((__m256i*)&batch.rounds[offset], rounds);
+    _mm256_store_si256((__m256i*)&batch.rng[offset], rng);
+}
+
+static bool use_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+void PlayoutBatch::playout(uint8_t max_rounds) {
+    if (!use_avx2()) {
+        playout_scalar(max_rounds);
+        return;
+    }
+    for (int offset = 0; offset < size; offset += 8) {
+        playout_avx2(*this, offset, max_rounds);
+    }
+}
+
+// Same policy as Game::playout, one step (a reroll, score or cross) per lane
+// per pass until every lane has played max_rounds.
+void PlayoutBatch::playout_scalar(uint8_t max_rounds) {
+    bool active = true;
+    while (active) {
+        active = false;
+        for (int l = 0; l < size; l++) {
+            if (rounds[l] >= max_rounds) {
+                continue;
+            }
+            active = true;
+
+            DiceLookup& lookup = dice_lookups[dice[l]];
+            uint32_t combined = lookup.category_mask & open[l];
+            bool turn_over = false;
+
+            uint32_t r = lane_rand(rng[l]);
+            if (lookup.categories.size() >= 1 && (r & 1)) {
+                int start = (((r >> 8) & 0xFF) * (1 + lookup.categories.size() / 3)) >> 8;
+                std::optional<uint8_t> i = next_valid_category(lookup, combined, start);
+                if (i.has_value()) {
+                    CategoryEntry entry = lookup.categories[i.value()];
+                    open[l] ^= 1 << (int)entry.category;
+                    score[l] += entry.score;
+                    if ((int)entry.category <= (int)Category::Sixes) {
+                        bonus[l] += entry.score;
+                    }
+                    turn_over = true;
+                }
+            }
+
+            if (!turn_over) {
+                if (rerolls[l] > 0) {
+                    Reroll& reroll = lookup.sorted_rerolls[0];
+                    dice[l] = freq_to_index(reroll.hold_freq) + lane_roll(rng[l], reroll.num_rolls);
+                    rerolls[l]--;
+                } else {
+                    open[l] ^= 1 << local_playout_tables->cross_category[open[l]];
+                    turn_over = true;
+                }
+            }
+
+            if (turn_over) {
+                rounds[l]++;
+                rerolls[l] += 2;
+                dice[l] = lane_roll(rng[l], 6);
+            }
+        }
+    }
+}
+
+// Sum over lanes of the final score, or of the estimated final score for
+// lanes stopped before the end of the game.
+uint64_t PlayoutBatch::total_score(Config const& config) {
+    uint64_t total = 0;
+    for (int l = 0; l < size; l++) {
+        uint32_t points = score[l] + (bonus[l] >= 75 ? 50 : 0);
+        if (open[l] == 0) {
+            total += points;
+        } else if (config.leaf_eval == LeafEval::Value) {
+            total += points + (uint32_t)std::lround(evaluate_state(open[l], bonus[l], rerolls[l]));
+        } else {
+            total += points + (uint32_t)std::lround(estimated_remaining(open[l], bonus[l]));
+        }
+    }
+    return total;
+}
+
+uint64_t batch_playout(Game& game, int count, Config const& config) {
+    uint8_t max_rounds = (uint8_t)Category::Count;
+    if (config.playout_rounds > 0) {
+        max_rounds = std::min(game.rounds + config.playout_rounds, (int)Category::Count);
+    } else if (config.leaf_eval == LeafEval::Value) {
+        max_rounds = game.rounds;
+    }
+
+    PlayoutBatch batch;
+    uint64_t total = 0;
+    while (count > 0) {
+        int size = std::min(count, MAX_BATCH);
+        batch.load(game, size);
+        batch.playout(max_rounds);
+        total += batch.total_score(config);
+        count -= size;
+    }
+    return total;
+}
@@ -0,0 +1,32 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "game.h"
+#include "run.h"
+#include <array>
+#include <cstdint>
+
+constexpr int MAX_BATCH = 64;
+
+// Independent single-player playouts from the same position, stored as a
+// structure of arrays so every step runs the same code over all lanes.
+struct PlayoutBatch {
+    int size = 0;
+    alignas(64) std::array<uint32_t, MAX_BATCH> dice{};    // freq_to_index of the dice
+    alignas(64) std::array<uint32_t, MAX_BATCH> open{};    // scored_mask
+    alignas(64) std::array<uint32_t, MAX_BATCH> bonus{};   // bonus_progress
+    alignas(64) std::array<uint32_t, MAX_BATCH> rerolls{};
+    alignas(64) std::array<uint32_t, MAX_BATCH> score{};   // sum of scored categories, without bonus
+    alignas(64) std::array<uint32_t, MAX_BATCH> rounds{};
+    alignas(64) std::array<uint32_t, MAX_BATCH> rng{};
+
+    void load(Game& game, int size);
+    // Runs the AVX2 kernel when the CPU has it, otherwise playout_scalar
+    void playout(uint8_t max_rounds);
+    void playout_scalar(uint8_t max_rounds);
+    uint64_t total_score(Config const& config);
+};
+
+uint64_t batch_playout(Game& game, int count, Config const& config);
+
+#endif // BATCH_HPP
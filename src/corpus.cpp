@@ -0,0 +1,96 @@
+#include "corpus.h"
+#include "match.h"
+#include "mcts.h"
+#include "protocol.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+std::vector<CorpusEntry> read_corpus(const std::string& path) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        throw std::invalid_argument("cannot open " + path);
+    }
+    std::vector<CorpusEntry> entries;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(ifs, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        try {
+            std::vector<std::string> fields;
+            std::istringstream iss(line);
+            std::string field;
+            while (std::getline(iss, field, '|')) {
+                fields.push_back(field);
+            }
+            std::istringstream position(fields[0]);
+            CorpusEntry entry{parse_position(position), {}};
+            for (size_t i = 1; i < fields.size(); i++) {
+                std::istringstream child(fields[i]);
+                ChildStats stats;
+                std::string move;
+                if (!(child >> stats.visits >> stats.total_score) || !std::getline(child, move)) {
+                    throw std::invalid_argument("expected <visits> <total score> <move>");
+                }
+                stats.move = Move().from_string(move);
+                entry.reference.push_back(stats);
+            }
+            if (entry.reference.empty()) {
+                throw std::invalid_argument("no reference moves");
+            }
+            entries.push_back(std::move(entry));
+        } catch (std::exception const& e) {
+            throw std::invalid_argument(path + ":" + std::to_string(line_number) + ": " + e.what());
+        }
+    }
+    return entries;
+}
+
+bool write_corpus(const std::string& path, std::vector<CorpusEntry>& entries) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        return false;
+    }
+    ofs << "# position | visits total_score move of every reference root move, most visited first\n";
+    for (CorpusEntry& entry : entries) {
+        ofs << position_string(entry.game);
+        for (ChildStats child : entry.reference) {
+            ofs << " | " << child.visits << " " << child.total_score << " " << child.move.to_string();
+        }
+        ofs << "\n";
+    }
+    return (bool)ofs;
+}
+
+void make_corpus(Config config, const std::string& path, int count, uint64_t seed) {
+    config.ponder = false;
+    std::cout << "Sampling " << count << " positions from seed " << seed << "..." << std::endl;
+    std::vector<CorpusEntry> entries;
+    for (Game& game : seeded_positions(seed, count)) {
+        SearchInfo info;
+        run_mcts(game, config, {}, &info);
+        entries.push_back({game, std::move(info.children)});
+        std::cout << "position " << entries.size() << " visits " << info.visits << std::endl;
+    }
+    if (!write_corpus(path, entries)) {
+        std::cerr << "Error: cannot write " << path << std::endl;
+        return;
+    }
+    std::cout << "Wrote " << entries.size() << " positions to " << path << std::endl;
+}
+
+std::optional<double> reference_loss(CorpusEntry const& entry, Move const& move) {
+    auto it = std::find_if(entry.reference.begin(), entry.reference.end(), [&](ChildStats const& c) {
+        return c.move == move;
+    });
+    if (it == entry.reference.end() || it->visits == 0) {
+        return std::nullopt;
+    }
+    return entry.reference.front().average_score() - it->average_score();
+}
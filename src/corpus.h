@@ -0,0 +1,32 @@
+#ifndef CORPUS_HPP
+#define CORPUS_HPP
+
+#include "run.h"
+#include "search.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+// A position with the root statistics of a long reference search
+struct CorpusEntry {
+    Game game;
+    // Most visited first, the first is the reference best move
+    std::vector<ChildStats> reference;
+};
+
+// One position per line: the fields of a position command, then every root
+// move of the reference search as "| <visits> <total score> <move>".
+// # starts a comment. Throws std::invalid_argument on a malformed line.
+std::vector<CorpusEntry> read_corpus(const std::string& path);
+bool write_corpus(const std::string& path, std::vector<CorpusEntry>& entries);
+
+// Samples count positions from games on seeded dice and searches each with
+// config, meant to be far longer than the budgets the corpus is used for
+void make_corpus(Config config, const std::string& path, int count, uint64_t seed);
+
+// Expected-score loss of playing move instead of the reference best move,
+// by the reference's own estimates; nullopt when the reference never tried
+// move, as it has no estimate for it
+std::optional<double> reference_loss(CorpusEntry const& entry, Move const& move);
+
+#endif // CORPUS_HPP
@@ -2,6 +2,7 @@
 #include "lookup.h"
 #include "utils.h"
 #include <algorithm>
+#include <bit>
 #include <cassert>
 #include <chrono>
 #include <cmath>
@@ -119,21 +120,48 @@ int Player::total_score() {
     int sum = 0;
     int i = 0;
     for (; i < 6; i++) {
-        sum += *scores[i];
+        sum += scores[i].value_or(0);
     }
     if (sum >= 75) {
         sum += 50;
     }
     for (; i < (int)Category::Count; i++) {
-        sum += *scores[i];
+        sum += scores[i].value_or(0);
     }
     return sum;
 }
 
+// Completion value of every open category. The bonus is counted as earned in
+// proportion to how far the open upper categories are expected to cover what
+// is still missing to 75.
+float estimated_remaining(uint32_t open, int bonus_progress) {
+    auto& values = completion_values[std::popcount(open)];
+    float score = 0;
+    float upper_remaining = 0;
+    for (int i = 0; i < (int)Category::Count; i++) {
+        if (open & (1 << i)) {
+            score += values[i];
+            if (i < 6) {
+                upper_remaining += values[i];
+            }
+        }
+    }
+    float deficit = 75.0f - bonus_progress;
+    if (deficit > 0 && upper_remaining > 0) {
+        float chance = std::clamp(0.5f + (upper_remaining - deficit) / upper_remaining, 0.0f, 1.0f);
+        score += 50.0f * chance;
+    }
+    return score;
+}
+
+float Player::estimated_score() {
+    return total_score() + estimated_remaining(scored_mask, bonus_progress);
+}
+
 std::string Reroll::to_string() {
     std::ostringstream oss;
     for (int i = 0; i < 6; i++) {
-        oss << (int)hold_freq[i] << " ";
+        oss << (i ? " " : "") << (int)hold_freq[i];
     }
     return oss.str();
 }
@@ -146,10 +174,16 @@ Dice::Dice() {
     reroll_all();
 }
 
+// A face from the thread's own generator; rand() takes a lock shared by
+// every search thread
+static inline int roll_die() {
+    return ((fast_rand_u32() & 0xFFFF) * 6) >> 16;
+}
+
 void Dice::reroll_all() {
     dice_freq.fill(0);
     for (int i = 0; i < 6; i++) {
-        dice_freq[rand() % 6]++;
+        dice_freq[roll_die()]++;
     }
 }
 
@@ -157,7 +191,7 @@ void Dice::reroll(Reroll const& reroll) {
     dice_freq = reroll.hold_freq;
     int num_rolls = reroll.num_rolls;
     while (num_rolls > 0) {
-        dice_freq[rand() % 6]++;
+        dice_freq[roll_die()]++;
         num_rolls--;
     }
 }
@@ -207,24 +241,36 @@ Move Move::from_string(const std::string& input) {
     Move m;
 
     if (cmd == "reroll") {
-        uint32_t mask = parse_uint(arg1);
-        if (mask > 0xFF)
-            throw std::out_of_range("Reroll mask must fit in uint8_t");
-
+        // The held dice as six frequencies, the rest are rolled
         m.type = Move::Type::Reroll;
-        // TODO: Finish
-        // m.reroll_mask = static_cast<uint8_t>(mask);
+        int held = 0;
+        for (int i = 0; i < 6; i++) {
+            if (i > 0 && !(iss >> arg1))
+                throw std::invalid_argument("Reroll needs 6 hold frequencies");
+            uint32_t freq = parse_uint(arg1);
+            if (freq > 6)
+                throw std::out_of_range("Hold frequency must be at most 6");
+            m.reroll.hold_freq[i] = freq;
+            held += freq;
+        }
+        if (held > 6)
+            throw std::out_of_range("Cannot hold more than 6 dice");
+        m.reroll.num_rolls = 6 - held;
     } else if (cmd == "cross") {
-        uint32_t index = parse_uint(arg1);
-        if (index > 0xFF)
-            throw std::out_of_range("Cross index must fit in uint8_t");
+        Category category = category_from_string(arg1);
+        uint32_t index = category == Category::Count ? parse_uint(arg1) : (uint32_t)category;
+        if (index >= (uint32_t)Category::Count)
+            throw std::out_of_range("Unknown category: " + arg1);
 
         m.type = Move::Type::Cross;
         m.crossed_category = (Category)index;
     } else if (cmd == "score") {
-        iss >> arg2;
+        if (!(iss >> arg2))
+            throw std::invalid_argument("Score needs a category and a score");
         m.type = Move::Type::Score;
         m.score_entry.category = category_from_string(arg1);
+        if (m.score_entry.category == Category::Count)
+            throw std::out_of_range("Unknown category: " + arg1);
         m.score_entry.score = parse_uint(arg2);
     } else {
         throw std::invalid_argument("Unknown move type: " + cmd);
@@ -299,58 +345,43 @@ void Game::play_move(Move move) {
     }
 }
 
-void Game::playout() {
-    while (!is_terminal()) {
+void Game::play_move(Move move, Dice const& next_dice) {
+    play_move(move);
+    dice = next_dice;
+}
+
+void Game::playout(uint8_t max_rounds) {
+    while (!is_terminal() && rounds < max_rounds) {
         DiceLookup& lookup = get_dice_lookup(dice);
-        // std::cout << dice.to_string() << std::endl;
-        // Move move;
         uint32_t combined = lookup.category_mask & player().scored_mask;
 
         if (lookup.categories.size() >= 1 && fast_rand(2)) {
             int start = fast_rand(1 + lookup.categories.size() / 3);
-            //int start = 0;
 
             std::optional<uint8_t> i = next_valid_category(lookup, combined, start);
-            if (!i.has_value()) {
-                break;
-            }
-
-            CategoryEntry category = lookup.categories[i.value()];
-
-            player().scores[(int)category.category] = category.score;
-            player().scored_mask ^= (int)category.category;
-            if ((int)category.category >= (int)Category::Ones && (int)category.category <= (int)Category::Sixes) {
-                player().bonus_progress += category.score;
+            if (i.has_value()) {
+                CategoryEntry category = lookup.categories[i.value()];
+
+                player().scores[(int)category.category] = category.score;
+                player().scored_mask ^= 1 << (int)category.category;
+                if ((int)category.category >= (int)Category::Ones && (int)category.category <= (int)Category::Sixes) {
+                    player().bonus_progress += category.score;
+                }
+                next_player();
+                continue;
             }
-            next_player();
-            continue;
         }
 
         if (player().rerolls > 0) {
-            //Reroll reroll = get_best_reroll(dice, player().scored_mask);
-            Reroll reroll = lookup.rerolls[0];
+            Reroll reroll = lookup.sorted_rerolls[0];
             dice.reroll(reroll);
             player().rerolls--;
         } else {
-            const uint32_t never_cross = ~0b10000000000000111100;
-            uint32_t i;
-            if (player().scored_mask & never_cross) {
-                i = (int)worst_category(player().scored_mask & never_cross);
-            } else {
-                i = (int)worst_category(player().scored_mask);
-            }
+            uint32_t i = local_playout_tables->cross_category[player().scored_mask];
             player().scored_mask ^= 1 << i;
             player().scores[i] = 0;
             next_player();
         }
-
-        // move.type = Move::Type::Cross;
-        // move.crossed_category = (Category)i;
-        // move.type = Move::Type::Reroll;
-        // move.reroll = lookup.rerolls[0];
-        // std::cout << move.to_string() << std::endl;
-
-        // std::cout << scores_string() << std::endl;
     }
 }
 
@@ -35,6 +35,7 @@ enum class Category : uint8_t {
 const char* category_to_string(Category c);
 Category category_from_string(std::string_view s);
 bool is_bonus_category(Category c);
+float estimated_remaining(uint32_t open, int bonus_progress);
 
 struct Player {
     std::array<std::optional<uint8_t>, (int)(Category::Count)> scores{};
@@ -43,6 +44,8 @@ struct Player {
     uint8_t rerolls = 2;
 
     int total_score();
+    float estimated_score();
+    bool operator==(const Player&) const = default;
 };
 
 struct CategoryEntry {
@@ -68,13 +71,14 @@ struct Dice {
     void reroll_all();
     void reroll(Reroll const& reroll);
     std::string to_string();
+    bool operator==(const Dice&) const = default;
 };
 
 struct Move {
     enum class Type { Reroll, Cross, Score } type;
     Reroll reroll;
     CategoryEntry score_entry;
-    Category crossed_category;
+    Category crossed_category = Category::Ones;
 
     Move();
     std::string to_string();
@@ -95,8 +99,11 @@ struct Game {
     Player& player();
     void next_player();
     void play_move(Move move);
-    void playout();
+    // Plays move, then sets the dice it rolled, e.g. when replaying a game
+    void play_move(Move move, Dice const& next_dice);
+    void playout(uint8_t max_rounds = (uint8_t)Category::Count);
     std::string scores_string();
+    bool operator==(const Game&) const = default;
 };
 
 #endif // GAME_HPP
@@ -1,16 +1,33 @@
 #include "lookup.h"
 #include "game.h"
+#include "shared_memory.h"
+#include "utils.h"
 #include <algorithm>
+#include <bit>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <type_traits>
 
 const std::string CACHE_FILENAME = "dice_lookups.bin";
 const std::string MASK_CACHE_FILENAME = "mask_lookups.bin";
 
-std::vector<DiceLookup> dice_lookups(117649);
-std::vector<MaskLookup> mask_lookups(1 << 20);
+constexpr size_t DICE_LOOKUP_COUNT = 117649;
+constexpr size_t MASK_LOOKUP_COUNT = 1 << 20;
+
+static_assert(std::is_trivially_copyable_v<DiceLookup>);
+static_assert(std::is_trivially_copyable_v<MaskLookup>);
+
+std::span<DiceLookup> dice_lookups;
+std::span<MaskLookup> mask_lookups;
+static SharedSegment dice_segment;
+PlayoutTables playout_tables;
+thread_local const PlayoutTables* local_playout_tables = &playout_tables;
 
 std::array<Dice, 462> all_dice;
 std::array<std::array<uint32_t, 12>, 12> pascals;
@@ -70,20 +87,60 @@ static bool load_binary(const std::string& filename, bool is_mask_table = false)
     } else {
         if (total_entries != dice_lookups.size())
             return false;
-        for (auto& entry : dice_lookups) {
+        for (size_t i = 0; i < total_entries; i++) {
+            DiceLookup entry{};
             size_t vec_size;
             ifs.read(reinterpret_cast<char*>(&vec_size), sizeof(vec_size));
+            if (!ifs || vec_size > entry.categories.entries.size())
+                return false;
             entry.categories.resize(vec_size);
             if (vec_size > 0) {
                 ifs.read(reinterpret_cast<char*>(entry.categories.data()), vec_size * sizeof(CategoryEntry));
             }
             ifs.read(reinterpret_cast<char*>(entry.sorted_rerolls.data()), entry.sorted_rerolls.size() * sizeof(Reroll));
             ifs.read(reinterpret_cast<char*>(&entry.category_mask), sizeof(entry.category_mask));
+            // Only the 462 real rolls are written, so the untouched pages of
+            // the table never take up memory
+            if (vec_size > 0 || entry.category_mask != 0) {
+                dice_lookups[i] = entry;
+            }
         }
     }
     return true;
 }
 
+static bool private_tables() {
+    const char* env = std::getenv("MAXI_YAHTZEE_PRIVATE_TABLES");
+    return env && *env && *env != '0';
+}
+
+static void* map_table(size_t bytes) {
+    void* data = map_anonymous(bytes);
+    if (!data) {
+        std::cerr << "panic: cannot map " << bytes << " bytes for a lookup table\n";
+        std::terminate();
+    }
+    return data;
+}
+
+static const std::string DICE_SEGMENT_PREFIX = "/maxi-yahtzee-dice-";
+
+// Named after the cache file it was filled from and the entry layout, so a
+// rebuilt cache or a changed DiceLookup gets a fresh segment
+static std::string dice_segment_name() {
+    struct stat st;
+    if (stat(CACHE_FILENAME.c_str(), &st) != 0) {
+        return "";
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (uint64_t value : {(uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec, (uint64_t)sizeof(DiceLookup)}) {
+        hash = (hash ^ value) * 1099511628211ull;
+    }
+    std::ostringstream oss;
+    oss << DICE_SEGMENT_PREFIX << std::hex << hash;
+    return oss.str();
+}
+
 std::array<int, (int)Category::Count> max_scores = {
     6,  // ONES
     12, // TWOS
@@ -132,7 +189,11 @@ std::array<double, (int)Category::Count> avg_scores = {
 std::array<double, (int)Category::Count> expected_values = {1.0,      2.0,       3.0,      4.0,     5.0,      6.0,     8.23478,  7.92181,  0.810185, 3.87899,
                                                             0.730967, 0.0697659, 0.810185, 1.08025, 0.324074, 3.57832, 0.135031, 0.202546, 21.0,     0.0128601};
 
-static size_t freq_to_index(std::array<uint8_t, 6> const& dice_freq) {
+// Average final score of a category under the Game::playout policy, given
+// how many categories are still open. Filled by init_completion_values.
+std::array<std::array<float, (int)Category::Count>, (int)Category::Count + 1> completion_values{};
+
+size_t freq_to_index(std::array<uint8_t, 6> const& dice_freq) {
     return dice_freq[0] + dice_freq[1] * 7 + dice_freq[2] * 7 * 7 + dice_freq[3] * 7 * 7 * 7 + dice_freq[4] * 7 * 7 * 7 * 7 + dice_freq[5] * 7 * 7 * 7 * 7 * 7;
 }
 
@@ -141,7 +202,7 @@ DiceLookup& get_dice_lookup(Dice dice) {
 }
 
 Reroll get_best_reroll(Dice dice, uint32_t mask) {
-    DiceLookup lookup = get_dice_lookup(dice);
+    DiceLookup& lookup = get_dice_lookup(dice);
     return mask_lookups[mask].best_rerolls[lookup.index];
 }
 
@@ -399,7 +460,10 @@ static void init_categories(std::array<uint8_t, 6>& dice_freq, DiceLookup& looku
         categories.push_back({Category::MaxiYahtzee, 100});
 
     // Store in lookup
-    lookup.categories = categories;
+    lookup.categories.resize(0);
+    for (auto& entry : categories) {
+        lookup.categories.push_back(entry);
+    }
     lookup.category_mask = 0;
     for (auto& entry : categories) {
         lookup.category_mask |= (1 << (int)entry.category);
@@ -409,9 +473,10 @@ static void init_categories(std::array<uint8_t, 6>& dice_freq, DiceLookup& looku
     const double HEURISTIC_THRESHOLD = 0.0; // Adjust as needed
 
     // 2. Remove "bad" entries first
-    std::erase_if(lookup.categories, [HEURISTIC_THRESHOLD](const CategoryEntry& entry) {
+    auto kept = std::remove_if(lookup.categories.begin(), lookup.categories.end(), [HEURISTIC_THRESHOLD](const CategoryEntry& entry) {
         return get_score_heuristic(entry) <= HEURISTIC_THRESHOLD;
     });
+    lookup.categories.resize(kept - lookup.categories.begin());
 
     // 3. Sort the survivors
     std::sort(lookup.categories.begin(), lookup.categories.end(), [](const CategoryEntry& a, const CategoryEntry& b) {
@@ -442,20 +507,70 @@ void init_index(std::array<uint8_t, 6>& dice_freq, DiceLookup& lookup) {
     lookup.index = index;
 }
 
-void init_dice_lookups() {
-    if (load_binary(CACHE_FILENAME, false)) {
-        std::cout << "Loaded dice lookups from cache." << std::endl;
-        return;
+// The index is not part of the cache file, so it is recomputed on load; a
+// table attached from shared memory already has it
+static void init_indices(bool write_index) {
+    for (uint8_t a1 = 0; a1 <= 6; ++a1) {
+        for (uint8_t a2 = 0; a2 <= 6 - a1; ++a2) {
+            for (uint8_t a3 = 0; a3 <= 6 - a1 - a2; ++a3) {
+                for (uint8_t a4 = 0; a4 <= 6 - a1 - a2 - a3; ++a4) {
+                    for (uint8_t a5 = 0; a5 <= 6 - a1 - a2 - a3 - a4; ++a5) {
+                        uint8_t a6 = 6 - a1 - a2 - a3 - a4 - a5;
+                        std::array<uint8_t, 6> dice_freq = {a1, a2, a3, a4, a5, a6};
+                        DiceLookup& lookup = dice_lookups[freq_to_index(dice_freq)];
+                        if (write_index) {
+                            init_index(dice_freq, lookup);
+                        }
+                        all_dice[lookup.index] = Dice(dice_freq);
+                    }
+                }
+            }
+        }
     }
+}
 
-    std::cout << "Cache not found. Computing lookup tables (this may take a while)..." << std::endl;
-
+void init_dice_lookups() {
     for (int n = 0; n < 12; ++n) {
         pascals[n][0] = 1;
         for (int k = 1; k <= n; ++k) {
             pascals[n][k] = pascals[n - 1][k - 1] + pascals[n - 1][k];
         }
     }
+
+    size_t bytes = DICE_LOOKUP_COUNT * sizeof(DiceLookup);
+    std::string name = private_tables() ? "" : dice_segment_name();
+    if (!name.empty()) {
+        SharedSegment::Role role = dice_segment.open(name, bytes);
+        if (role != SharedSegment::Role::Failed) {
+            dice_lookups = std::span(static_cast<DiceLookup*>(dice_segment.data()), DICE_LOOKUP_COUNT);
+        }
+        if (role == SharedSegment::Role::Attached) {
+            init_indices(false);
+            std::cout << "Attached dice lookups from shared memory." << std::endl;
+            return;
+        }
+        if (role == SharedSegment::Role::Creator) {
+            if (load_binary(CACHE_FILENAME, false)) {
+                init_indices(true);
+                dice_segment.mark_ready();
+                // Segments of earlier caches would otherwise stay until reboot
+                unlink_other_segments(DICE_SEGMENT_PREFIX, name);
+                std::cout << "Loaded dice lookups from cache into shared memory." << std::endl;
+                return;
+            }
+            dice_segment.abandon();
+        }
+    }
+
+    dice_lookups = std::span(static_cast<DiceLookup*>(map_table(bytes)), DICE_LOOKUP_COUNT);
+    if (load_binary(CACHE_FILENAME, false)) {
+        init_indices(true);
+        std::cout << "Loaded dice lookups from cache." << std::endl;
+        return;
+    }
+
+    std::cout << "Cache not found. Computing lookup tables (this may take a while)..." << std::endl;
+
     for (uint8_t a1 = 0; a1 <= 6; ++a1) {
         for (uint8_t a2 = 0; a2 <= 6 - a1; ++a2) {
             for (uint8_t a3 = 0; a3 <= 6 - a1 - a2; ++a3) {
@@ -478,7 +593,94 @@ void init_dice_lookups() {
     save_binary(CACHE_FILENAME, false);
 }
 
+void init_playout_tables() {
+    const uint32_t never_cross = ~0b10000000000000111100;
+
+    playout_tables.dice_rank.assign(dice_lookups.size(), 0);
+    // One spare rank so 32-bit gathers of the last entries stay in bounds
+    playout_tables.positions.assign(all_dice.size() + 1, {});
+    playout_tables.cross_category.assign(mask_lookups.size() + 4, 0);
+
+    for (size_t rank = 0; rank < all_dice.size(); rank++) {
+        size_t dice_index = freq_to_index(all_dice[rank].dice_freq);
+        DiceLookup& lookup = dice_lookups[dice_index];
+        int count = std::min<int>(lookup.categories.size(), PLAYOUT_MAX_CATEGORIES);
+
+        playout_tables.dice_rank[dice_index] = rank;
+        playout_tables.category_mask[rank] = lookup.category_mask;
+        playout_tables.start_range[rank] = 1 + lookup.categories.size() / 3;
+        playout_tables.reroll_hold[rank] = freq_to_index(lookup.sorted_rerolls[0].hold_freq);
+        playout_tables.reroll_count[rank] = lookup.sorted_rerolls[0].num_rolls;
+        for (int i = 0; i < PLAYOUT_MAX_CATEGORIES; i++) {
+            CategoryEntry entry = i < count ? lookup.categories[i] : CategoryEntry{Category::Count, 0};
+            playout_tables.categories[rank][i] = (uint32_t)entry.category | (uint32_t)entry.score << 8;
+        }
+        for (int chunk = 0; chunk < 3; chunk++) {
+            for (uint32_t bits = 0; bits < 128; bits++) {
+                uint32_t mask = bits << (7 * chunk);
+                uint16_t positions = 0;
+                for (int i = 0; i < count; i++) {
+                    if (mask & (1 << (int)lookup.categories[i].category)) {
+                        positions |= 1 << i;
+                    }
+                }
+                playout_tables.positions[rank][chunk][bits] = positions;
+            }
+        }
+    }
+
+    for (size_t mask = 1; mask < mask_lookups.size(); mask++) {
+        uint32_t crossable = mask & never_cross ? mask & never_cross : mask;
+        playout_tables.cross_category[mask] = (uint8_t)worst_category(crossable);
+    }
+}
+
+void init_completion_values(int games) {
+    std::array<std::array<double, (int)Category::Count>, (int)Category::Count + 1> sums{};
+    std::array<std::array<uint32_t, (int)Category::Count>, (int)Category::Count + 1> counts{};
+    std::array<uint32_t, (int)Category::Count> masks;
+
+    for (int g = 0; g < games; g++) {
+        Game game = Game(1);
+        int n = 0;
+        while (!game.is_terminal()) {
+            masks[n] = game.player().scored_mask;
+            n++;
+            game.playout(game.rounds + 1);
+        }
+        Player& player = game.players[0];
+        for (int r = 0; r < n; r++) {
+            int open = std::popcount(masks[r]);
+            for (int i = 0; i < (int)Category::Count; i++) {
+                if (masks[r] & (1 << i)) {
+                    sums[open][i] += player.scores[i].value_or(0);
+                    counts[open][i]++;
+                }
+            }
+        }
+    }
+
+    for (int open = 1; open <= (int)Category::Count; open++) {
+        for (int i = 0; i < (int)Category::Count; i++) {
+            completion_values[open][i] = counts[open][i] ? sums[open][i] / counts[open][i] : 0.0;
+        }
+    }
+}
+
 void init_mask_lookups() {
+    size_t bytes = MASK_LOOKUP_COUNT * sizeof(MaskLookup);
+    if (!private_tables()) {
+        size_t file_bytes = 0;
+        const char* file = static_cast<const char*>(map_file_read_only(MASK_CACHE_FILENAME, file_bytes));
+        if (file && file_bytes == sizeof(size_t) + bytes && *reinterpret_cast<const size_t*>(file) == MASK_LOOKUP_COUNT) {
+            // MaskLookup is byte aligned, so the table can start right after the count
+            mask_lookups = std::span(reinterpret_cast<MaskLookup*>(const_cast<char*>(file) + sizeof(size_t)), MASK_LOOKUP_COUNT);
+            std::cout << "Mapped mask lookups from cache." << std::endl;
+            return;
+        }
+    }
+
+    mask_lookups = std::span(static_cast<MaskLookup*>(map_table(bytes)), MASK_LOOKUP_COUNT);
     if (load_binary(MASK_CACHE_FILENAME, true)) {
         std::cout << "Loaded mask lookups from cache." << std::endl;
         return;
@@ -4,13 +4,40 @@
 #include "game.h"
 #include <array>
 #include <cstdint>
+#include <span>
+#include <stdexcept>
 
 extern std::array<int, (int)Category::Count> max_scores;
 extern std::array<double, (int)Category::Count> avg_scores;
 extern std::array<double, (int)Category::Count> expected_values;
+extern std::array<std::array<float, (int)Category::Count>, (int)Category::Count + 1> completion_values;
+
+// Fixed capacity list of a roll's categories. It keeps DiceLookup trivially
+// copyable, so the table can live in memory shared between processes.
+struct CategoryList {
+    std::array<CategoryEntry, (int)Category::Count> entries;
+    uint8_t count = 0;
+
+    size_t size() const { return count; }
+    void resize(size_t n) { count = n; }
+    void push_back(CategoryEntry entry) { entries[count++] = entry; }
+    CategoryEntry* data() { return entries.data(); }
+    const CategoryEntry* data() const { return entries.data(); }
+    CategoryEntry* begin() { return entries.data(); }
+    CategoryEntry* end() { return entries.data() + count; }
+    const CategoryEntry* begin() const { return entries.data(); }
+    const CategoryEntry* end() const { return entries.data() + count; }
+    CategoryEntry& operator[](size_t i) { return entries[i]; }
+    const CategoryEntry& operator[](size_t i) const { return entries[i]; }
+    const CategoryEntry& at(size_t i) const {
+        if (i >= count)
+            throw std::out_of_range("CategoryList::at");
+        return entries[i];
+    }
+};
 
 struct DiceLookup {
-    std::vector<CategoryEntry> categories;
+    CategoryList categories;
     std::array<Reroll, 63> rerolls;
     std::array<Reroll, 63> sorted_rerolls;
     std::array<std::array<float, (int)Category::Count>, 63> reroll_category_evs;
@@ -21,12 +48,54 @@ struct DiceLookup {
 
 struct MaskLookup {
     std::array<Reroll, 462> best_rerolls;
+    // Unused, kept for the layout of mask_lookups.bin; the crossed category
+    // is PlayoutTables::cross_category
     uint8_t worst_category;
 };
 
+constexpr int PLAYOUT_MAX_CATEGORIES = 16;
+
+// Flat copies of the DiceLookup fields used by the playout policy, indexed by
+// DiceLookup::index (the rank) so they can be gathered by the batch kernels.
+struct PlayoutTables {
+    std::vector<uint32_t> dice_rank; // indexed by freq_to_index
+    std::array<uint32_t, 462> category_mask;
+    std::array<uint32_t, 462> start_range;
+    std::array<uint32_t, 462> reroll_hold; // freq_to_index of the held dice
+    std::array<uint32_t, 462> reroll_count;
+    // category | score << 8, in DiceLookup::categories order
+    std::array<std::array<uint32_t, PLAYOUT_MAX_CATEGORIES>, 462> categories;
+    // Bits of the positions in DiceLookup::categories whose category is set in
+    // a mask, one table per 7-bit chunk of the mask: positions[rank][chunk][bits]
+    std::vector<std::array<std::array<uint16_t, 128>, 3>> positions;
+    // Category the playout crosses for each scored_mask
+    std::vector<uint8_t> cross_category;
+};
+
+// Indexed by freq_to_index, i.e. the dice frequencies read as a base 7 number.
+// Both tables are views of memory shared between engine processes when
+// possible: mask_lookups maps mask_lookups.bin read-only, dice_lookups lives
+// in a named shared memory segment. Neither may be written after init.
+extern std::span<DiceLookup> dice_lookups;
+extern std::span<MaskLookup> mask_lookups;
+extern PlayoutTables playout_tables;
+// Copy of playout_tables used by the calling thread, a replica on its NUMA
+// node when placement replicates them
+extern thread_local const PlayoutTables* local_playout_tables;
+
+// Set MAXI_YAHTZEE_PRIVATE_TABLES=1 to keep the tables out of shared memory
 void init_dice_lookups();
 void init_mask_lookups();
+void init_completion_values(int games = 50000);
+// Must run before any playout
+void init_playout_tables();
+
+inline uint32_t category_positions(uint32_t rank, uint32_t mask) {
+    auto& chunks = local_playout_tables->positions[rank];
+    return chunks[0][mask & 127] | chunks[1][(mask >> 7) & 127] | chunks[2][mask >> 14];
+}
 Reroll get_best_reroll(Dice dice, uint32_t mask);
 DiceLookup& get_dice_lookup(Dice dice);
+size_t freq_to_index(std::array<uint8_t, 6> const& dice_freq);
 double get_score_heuristic(CategoryEntry entry);
 void calculate_global_category_evs();
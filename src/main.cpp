@@ -2,7 +2,9 @@
 #include "mcts.h"
 #include "lookup.h"
 #include "run.h"
+#include "trace.h"
 #include "utils.h"
+#include "value.h"
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
@@ -18,5 +20,11 @@ int main(int argc, char* argv[]) {
 
     init_dice_lookups();
     init_mask_lookups();
+    init_playout_tables();
+    init_completion_values();
+    init_value_table();
     run_args(argc, argv);
+    // Workers record trace events, so the trace is written once they are joined
+    shutdown_pool();
+    write_trace();
 }
@@ -0,0 +1,171 @@
+#include "match.h"
+#include "mcts.h"
+#include "scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+extern thread_local uint32_t rng_state;
+
+// Pairs needed before the variance estimate is trusted by the SPRT
+constexpr int MIN_PAIRS = 16;
+
+static uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+Dice seeded_roll(uint64_t seed, int turn, int roll, Reroll const& reroll) {
+    uint64_t state = seed ^ ((uint64_t)turn << 40) ^ ((uint64_t)roll << 32);
+    splitmix64(state);
+    Dice dice(reroll.hold_freq);
+    for (int i = 0; i < reroll.num_rolls; i++) {
+        dice.dice_freq[splitmix64(state) % 6]++;
+    }
+    return dice;
+}
+
+int play_seeded_game(Config const& config, uint64_t seed, std::function<void(Game const&)> on_position) {
+    Reroll all;
+    all.num_rolls = 6;
+    int turn = 0;
+    int roll = 0;
+    Game game(1);
+    game.dice = seeded_roll(seed, turn, roll, all);
+    while (!game.is_terminal()) {
+        if (on_position) {
+            on_position(game);
+        }
+        Move move = run_mcts(game, config);
+        if (move.type == Move::Type::Reroll) {
+            roll++;
+            game.play_move(move, seeded_roll(seed, turn, roll, move.reroll));
+        } else {
+            turn++;
+            roll = 0;
+            game.play_move(move, seeded_roll(seed, turn, roll, all));
+        }
+    }
+    return game.players[0].total_score();
+}
+
+std::vector<Game> seeded_positions(uint64_t seed, int count) {
+    // Every few positions, so the sample covers the whole game
+    constexpr int STRIDE = 5;
+    Config config;
+    config.threads = 1;
+    config.iterations = 200;
+    std::vector<Game> positions;
+    for (uint64_t game_seed = seed; (int)positions.size() < count; game_seed++) {
+        int index = game_seed % STRIDE;
+        play_seeded_game(config, game_seed, [&](Game const& game) {
+            if (index++ % STRIDE == 0 && (int)positions.size() < count) {
+                positions.push_back(game);
+            }
+        });
+    }
+    return positions;
+}
+
+// Gaussian SPRT on the paired differences with the variance estimated from
+// the sample, as the score distribution isn't known up front
+struct Sprt {
+    double delta;
+    double lower;
+    double upper;
+    int64_t pairs = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    Sprt(MatchOptions const& options)
+        : delta(options.delta), lower(std::log(options.beta / (1 - options.alpha))), upper(std::log((1 - options.beta) / options.alpha)) {}
+
+    void add(double difference) {
+        pairs++;
+        double d = difference - mean;
+        mean += d / pairs;
+        m2 += d * (difference - mean);
+    }
+    double variance() const {
+        return pairs > 1 ? m2 / (pairs - 1) : 0;
+    }
+    double llr() const {
+        double var = variance();
+        if (pairs < MIN_PAIRS || var <= 0) {
+            return 0;
+        }
+        return delta / var * pairs * (mean - delta / 2);
+    }
+    int decision() const {
+        double l = llr();
+        return l >= upper ? 1 : l <= lower ? -1 : 0;
+    }
+};
+
+int run_match(Config base, Config test, MatchOptions const& options) {
+    Scheduler& pool = ensure_pool_exists(base);
+    // Pairs run side by side, each search on the worker playing the pair
+    base.threads = test.threads = 1;
+    base.ponder = test.ponder = false;
+
+    Sprt sprt(options);
+    std::mutex mutex;
+    int64_t base_total = 0;
+    int64_t test_total = 0;
+    std::atomic<bool> decided = false;
+    auto start = std::chrono::steady_clock::now();
+
+    auto report = [&](const char* label) {
+        double stddev = std::sqrt(sprt.variance());
+        double margin = sprt.pairs > 1 ? 1.96 * stddev / std::sqrt((double)sprt.pairs) : 0;
+        std::cout << std::fixed << std::setprecision(3) << label << " pairs " << sprt.pairs << " base " << (double)base_total / sprt.pairs << " test " << (double)test_total / sprt.pairs << " diff "
+                  << sprt.mean << " +- " << margin << " stddev " << stddev << " llr " << sprt.llr() << " [" << sprt.lower << ", " << sprt.upper << "]" << std::endl;
+    };
+
+    TaskGroup group;
+    for (int i = 0; i < base.games; i++) {
+        pool.submit(
+            [&, i]() {
+                if (decided.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                uint64_t seed = options.seed * 0x100000001B3ull + i;
+                rng_state = seed ^ 0x2545F491;
+                int base_score = play_seeded_game(base, seed);
+                rng_state = seed ^ 0x2545F491;
+                int test_score = play_seeded_game(test, seed);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decided) {
+                    return;
+                }
+                base_total += base_score;
+                test_total += test_score;
+                sprt.add(test_score - base_score);
+                if (sprt.pairs % options.report_interval == 0) {
+                    report("match");
+                }
+                if (sprt.decision() != 0) {
+                    decided = true;
+                }
+            },
+            group);
+    }
+    pool.wait(group);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (sprt.pairs == 0) {
+        std::cout << "match: no games played" << std::endl;
+        return 0;
+    }
+    report("final");
+    int decision = sprt.decision();
+    std::cout << (decision > 0 ? "H1 accepted: test is better by " : decision < 0 ? "H0 accepted: test is not better by " : "Undecided after " + std::to_string(sprt.pairs) + " pairs, delta ")
+              << options.delta << " points (" << std::setprecision(1) << seconds << " s)" << std::endl;
+    return decision;
+}
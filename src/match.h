@@ -0,0 +1,40 @@
+#ifndef MATCH_HPP
+#define MATCH_HPP
+
+#include "run.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct MatchOptions {
+    // Score difference per game, test minus base, that H1 claims
+    double delta = 1.0;
+    // False positive and false negative rates of the SPRT
+    double alpha = 0.05;
+    double beta = 0.05;
+    // Every pair's dice stream derives from seed and the pair index
+    uint64_t seed = 1;
+    // Pairs read between two progress lines
+    int report_interval = 100;
+};
+
+// Plays base and test on the same dice, one pair of single player games per
+// task on config.threads workers, and runs a sequential probability ratio
+// test on the score differences: H0 is a mean difference of 0, H1 one of
+// options.delta. Stops once either is accepted, or after base.games pairs.
+// Every search is single-threaded, -m only sets how many pairs run at once.
+// Returns 1 when H1 was accepted, -1 for H0 and 0 when undecided.
+int run_match(Config base, Config test, MatchOptions const& options);
+
+// Dice of the given roll of a seeded game: turn counts the turns from 0,
+// roll the rolls within the turn from 0. Both engines of a pair roll the
+// same dice in the same spot, whatever they did before.
+Dice seeded_roll(uint64_t seed, int turn, int roll, Reroll const& reroll);
+// Plays a single player game on the dice of seed, returns the score.
+// on_position sees every position before its move is searched.
+int play_seeded_game(Config const& config, uint64_t seed, std::function<void(Game const&)> on_position = nullptr);
+// count positions spread over games on seeded dice played by quick searches,
+// the same for the same seed up to the search's own randomness
+std::vector<Game> seeded_positions(uint64_t seed, int count);
+
+#endif // MATCH_HPP
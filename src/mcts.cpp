@@ -1,7 +1,10 @@
 #include "mcts.h"
+#include "batch.h"
 #include "game.h"
 #include "lookup.h"
+#include "profile.h"
 #include "utils.h"
+#include "value.h"
 #include <algorithm>
 #include <cmath>
 #include <iomanip>
@@ -157,31 +160,64 @@ MCTSNode* MCTSNode::expand() {
     return children.back().get();
 }
 
-void MCTSNode::backpropagate(Game& sim_game, uint8_t win_score) {
-    visits++;
-    total_score += win_score;
+void MCTSNode::backpropagate(uint32_t count, uint64_t score) {
+    visits += count;
+    total_score += score;
     // if (player_i == winner) {
     //     wins++;
     // }
 
     if (parent != nullptr) {
-        parent->backpropagate(sim_game, win_score);
+        parent->backpropagate(count, score);
     }
 }
 
-void MCTSNode::run_iteration() {
-    MCTSNode* leaf = select_child();
-    MCTSNode* node = leaf->expand();
-    Game sim_game = node->game;
+uint32_t MCTSNode::simulate(Config const& config) {
+    Game sim_game = game;
+    if (config.leaf_eval == LeafEval::Value) {
+        sim_game.playout(std::min(sim_game.rounds + config.playout_rounds, (int)Category::Count));
+        Player& player = sim_game.players[0];
+        return player.total_score() + (uint32_t)std::lround(evaluate_player(player));
+    }
+    if (config.playout_rounds > 0) {
+        sim_game.playout(std::min(sim_game.rounds + config.playout_rounds, (int)Category::Count));
+        return (uint32_t)std::lround(sim_game.players[0].estimated_score());
+    }
     sim_game.playout();
-    int win_score = sim_game.players[0].total_score();
-    //if (sim_game.players[0].bonus_progress < 75) {
-    //    win_score = 0;
-    //}
-    lowest_score = std::min(lowest_score, win_score);
-    highest_score = std::max(highest_score, win_score);
-    // std::cout << sim_game.scores_string() << std::endl;
-    node->backpropagate(sim_game, win_score);
+    return sim_game.players[0].total_score();
+}
+
+void MCTSNode::run_iteration(Config const& config) {
+    MCTSNode* leaf;
+    {
+        PhaseTimer timer(Phase::Select);
+        leaf = select_child();
+    }
+    MCTSNode* node;
+    {
+        // Includes the child's Game copy and constructor
+        PhaseTimer timer(Phase::Expand);
+        node = leaf->expand();
+    }
+    uint32_t count = 1;
+    uint64_t score;
+    {
+        PhaseTimer timer(Phase::Playout);
+        // A value table without playout rounds, or a finished game, gives
+        // the same score every time, so more playouts add visits but no
+        // information
+        bool deterministic = node->game.is_terminal() || (config.leaf_eval == LeafEval::Value && config.playout_rounds == 0);
+        if (config.leaf_batch > 1 && node->game.players.size() == 1 && !deterministic) {
+            count = config.leaf_batch;
+            score = batch_playout(node->game, config.leaf_batch, config);
+        } else {
+            score = node->simulate(config);
+            lowest_score = std::min(lowest_score, (int)score);
+            highest_score = std::max(highest_score, (int)score);
+        }
+    }
+    PhaseTimer timer(Phase::Backpropagate);
+    node->backpropagate(count, score);
 }
 
 Move MCTSNode::next_move() {
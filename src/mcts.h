@@ -3,6 +3,7 @@
 
 #include "game.h"
 #include "lookup.h"
+#include "run.h"
 #include <fstream>
 #include <limits>
 #include <memory>
@@ -50,9 +51,9 @@ struct MCTSNode {
     bool crosses_left();
     MCTSNode* select_child();
     MCTSNode* expand();
-    uint8_t simulate();
-    void backpropagate(Game& sim_game, uint8_t total_score);
-    void run_iteration();
+    uint32_t simulate(Config const& config);
+    void backpropagate(uint32_t count, uint64_t score);
+    void run_iteration(Config const& config);
     Move next_move();
     MCTSNode* best_child() const;
     std::string node_string();
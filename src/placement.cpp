@@ -0,0 +1,207 @@
+#include "placement.h"
+#include "lookup.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+// Memory policy constants from <numaif.h>, which is only shipped with libnuma
+constexpr int MPOL_PREFERRED_MODE = 1;
+constexpr int MPOL_INTERLEAVE_MODE = 3;
+constexpr unsigned MPOL_MF_MOVE_FLAG = 1 << 1;
+
+static Placement placement;
+static std::vector<int> node_ids;
+static std::vector<std::unique_ptr<PlayoutTables>> replicas;
+static std::string tables_status = "tables: not placed";
+
+static std::vector<int> parse_cpulist(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+static std::vector<int> allowed_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+static void read_topology() {
+    std::vector<int> allowed = allowed_cpus();
+    placement.node_cpus.clear();
+    node_ids.clear();
+
+    for (int node = 0; node < 64; node++) {
+        std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!ifs) {
+            continue;
+        }
+        std::string list;
+        std::getline(ifs, list);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpulist(list)) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            placement.node_cpus.push_back(cpus);
+            node_ids.push_back(node);
+        }
+    }
+
+    // No sysfs topology, treat the machine as one node
+    if (placement.node_cpus.empty()) {
+        placement.node_cpus.push_back(allowed);
+        node_ids.push_back(0);
+    }
+}
+
+static void set_affinity(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static bool prefer_node(int node) {
+    unsigned long mask = 1UL << node_ids[node];
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &mask, sizeof(mask) * 8) == 0;
+}
+
+// Spreads the pages of a table round robin over every node with workers
+static bool interleave(const void* data, size_t bytes) {
+    unsigned long mask = 0;
+    for (int node : placement.worker_nodes) {
+        mask |= 1UL << node_ids[node];
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)data + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)data + bytes) & ~(uintptr_t)(page - 1);
+    if (end <= start) {
+        return false;
+    }
+    return syscall(SYS_mbind, start, end - start, MPOL_INTERLEAVE_MODE, &mask, sizeof(mask) * 8, MPOL_MF_MOVE_FLAG) == 0;
+}
+
+void init_placement(int num_workers, bool pin, bool numa) {
+    placement.pin = pin;
+    placement.numa = numa;
+    read_topology();
+
+    // Node-major order, so workers fill one node before moving to the next
+    std::vector<std::pair<int, int>> slots;
+    for (size_t node = 0; node < placement.node_cpus.size(); node++) {
+        for (int cpu : placement.node_cpus[node]) {
+            slots.push_back({cpu, node});
+        }
+    }
+    placement.worker_cpus.resize(num_workers);
+    placement.worker_nodes.resize(num_workers);
+    for (int w = 0; w < num_workers; w++) {
+        placement.worker_cpus[w] = slots[w % slots.size()].first;
+        placement.worker_nodes[w] = slots[w % slots.size()].second;
+    }
+
+    if (!numa) {
+        return;
+    }
+
+    // Each replica is built by a thread running on its node, so first touch
+    // puts the pages there
+    replicas.clear();
+    replicas.resize(placement.node_cpus.size());
+    int replicated = 0;
+    for (size_t node = 0; node < placement.node_cpus.size(); node++) {
+        if (std::find(placement.worker_nodes.begin(), placement.worker_nodes.end(), (int)node) == placement.worker_nodes.end()) {
+            continue;
+        }
+        std::thread builder([node] {
+            set_affinity(placement.node_cpus[node]);
+            prefer_node(node);
+            replicas[node] = std::make_unique<PlayoutTables>(playout_tables);
+        });
+        builder.join();
+        replicated++;
+    }
+
+    std::ostringstream oss;
+    oss << "tables: playout tables replicated on " << replicated << " node(s)";
+    if (replicated > 1) {
+        bool dice = interleave(dice_lookups.data(), dice_lookups.size() * sizeof(DiceLookup));
+        bool masks = interleave(mask_lookups.data(), mask_lookups.size() * sizeof(MaskLookup));
+        oss << ", dice lookups " << (dice ? "interleaved" : "not interleaved") << ", mask lookups " << (masks ? "interleaved" : "not interleaved");
+    } else {
+        oss << ", dice and mask lookups local to the only node";
+    }
+    tables_status = oss.str();
+}
+
+void apply_worker_placement(int worker) {
+    if (worker >= (int)placement.worker_cpus.size()) {
+        return;
+    }
+    int node = placement.worker_nodes[worker];
+    if (placement.pin) {
+        set_affinity({placement.worker_cpus[worker]});
+    } else if (placement.numa) {
+        set_affinity(placement.node_cpus[node]);
+    }
+    if (placement.numa) {
+        prefer_node(node);
+        if (replicas[node]) {
+            local_playout_tables = replicas[node].get();
+        }
+    }
+}
+
+std::string placement_report() {
+    std::ostringstream oss;
+    oss << "Placement: " << placement.node_cpus.size() << " NUMA node(s), pin " << (placement.pin ? "on" : "off") << ", numa " << (placement.numa ? "on" : "off") << "\n";
+    for (size_t node = 0; node < placement.node_cpus.size(); node++) {
+        oss << "  node " << node_ids[node] << ": " << placement.node_cpus[node].size() << " cpu(s)\n";
+    }
+    for (size_t w = 0; w < placement.worker_cpus.size(); w++) {
+        oss << "  worker " << w << " -> ";
+        if (placement.pin) {
+            oss << "cpu " << placement.worker_cpus[w] << " ";
+        }
+        oss << "node " << node_ids[placement.worker_nodes[w]] << "\n";
+    }
+    oss << "  " << tables_status;
+    return oss.str();
+}
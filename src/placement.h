@@ -0,0 +1,26 @@
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <string>
+#include <vector>
+
+// Where each pool worker runs, decided once before the pool starts
+struct Placement {
+    bool pin = false;
+    bool numa = false;
+    // CPUs of every NUMA node, restricted to the ones this process may use
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<int> worker_cpus;
+    std::vector<int> worker_nodes;
+};
+
+// With pin, workers are pinned to consecutive allowed CPUs, filling one node
+// before the next. With numa, playout_tables are replicated on every node
+// that runs workers, the dice and mask lookups are interleaved across the
+// nodes, and workers prefer allocating (their trees) on their own node.
+void init_placement(int num_workers, bool pin, bool numa);
+// Called by every pool worker when it starts
+void apply_worker_placement(int worker);
+std::string placement_report();
+
+#endif // PLACEMENT_HPP
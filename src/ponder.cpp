@@ -0,0 +1,108 @@
+#include "ponder.h"
+#include "trace.h"
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <thread>
+
+extern thread_local uint32_t rng_state;
+
+std::atomic<int64_t> ponder_hits = 0;
+std::atomic<int64_t> ponder_misses = 0;
+
+// Successor positions drawn per move, and how many of the most frequent are
+// searched. Rerolls of one or two dice have at most 21 outcomes and are
+// almost always covered, a fresh roll of all six is spread over 462.
+constexpr int PONDER_SAMPLES = 1024;
+constexpr int PONDER_POSITIONS = 16;
+
+Ponder::~Ponder() {
+    stop();
+}
+
+bool Ponder::running() const {
+    return group != nullptr;
+}
+
+void Ponder::start(Game const& game, Move const& move, Config const& config) {
+    stop();
+    candidates.clear();
+    schedule.clear();
+    pool = &ensure_pool_exists(config);
+    // One root per thread of the search the roots are handed to
+    int threads = std::clamp(config.threads, 1, pool->size());
+
+    for (int i = 0; i < PONDER_SAMPLES; i++) {
+        Game next = game;
+        next.play_move(move);
+        if (next.is_terminal()) {
+            return;
+        }
+        auto it = std::find_if(candidates.begin(), candidates.end(), [&](Candidate const& c) {
+            return c.game == next;
+        });
+        if (it == candidates.end()) {
+            candidates.push_back({next, 1, {}});
+        } else {
+            it->hits++;
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+        return a.hits > b.hits;
+    });
+    if (candidates.size() > PONDER_POSITIONS) {
+        candidates.erase(candidates.begin() + PONDER_POSITIONS, candidates.end());
+    }
+    for (size_t c = 0; c < candidates.size(); c++) {
+        for (int t = 0; t < threads; t++) {
+            candidates[c].roots.push_back(std::make_unique<MCTSNode>(candidates[c].game));
+        }
+        schedule.insert(schedule.end(), candidates[c].hits, c);
+    }
+    std::shuffle(schedule.begin(), schedule.end(), std::minstd_rand(PONDER_SAMPLES));
+
+    // Each task owns the roots of one search thread, so no tree is shared
+    group = std::make_unique<TaskGroup>();
+    stopping = false;
+    for (int t = 0; t < threads; t++) {
+        pool->submit(
+            [this, t, threads, config]() {
+                TraceScope trace("ponder");
+                rng_state = std::hash<std::thread::id>{}(std::this_thread::get_id()) ^ (t * 2654435761u);
+                size_t step = t * schedule.size() / threads;
+                while (!stopping.load(std::memory_order_relaxed)) {
+                    candidates[schedule[step++ % schedule.size()]].roots[t]->run_iteration(config);
+                }
+            },
+            *group);
+    }
+}
+
+void Ponder::stop() {
+    if (!group) {
+        return;
+    }
+    stopping = true;
+    pool->wait(*group);
+    group.reset();
+}
+
+std::vector<std::unique_ptr<MCTSNode>> Ponder::take(Game const& actual) {
+    stop();
+    std::vector<std::unique_ptr<MCTSNode>> roots;
+    for (Candidate& candidate : candidates) {
+        if (candidate.game == actual) {
+            roots = std::move(candidate.roots);
+            break;
+        }
+    }
+    if (!roots.empty()) {
+        ponder_hits++;
+    } else if (!candidates.empty()) {
+        ponder_misses++;
+    }
+    candidates.clear();
+    schedule.clear();
+    return roots;
+}
@@ -0,0 +1,46 @@
+#ifndef PONDER_HPP
+#define PONDER_HPP
+
+#include "game.h"
+#include "mcts.h"
+#include "run.h"
+#include "scheduler.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Keeps searching while the next position is not known yet. The positions a
+// move can lead to are sampled, and the most likely ones are searched on the
+// pool in the background. Once the actual position is supplied, its trees are
+// handed to run_mcts instead of starting from an empty root.
+class Ponder {
+public:
+    ~Ponder();
+    // game is the position before move is played
+    void start(Game const& game, Move const& move, Config const& config);
+    // Stops pondering and returns one root per search thread grown for
+    // actual, or nothing when actual was not among the pondered positions
+    std::vector<std::unique_ptr<MCTSNode>> take(Game const& actual);
+    void stop();
+    bool running() const;
+
+private:
+    struct Candidate {
+        Game game;
+        int hits = 0;
+        std::vector<std::unique_ptr<MCTSNode>> roots;
+    };
+
+    std::vector<Candidate> candidates;
+    // Candidate indices repeated by their hits, so likely positions get
+    // proportionally more iterations
+    std::vector<int> schedule;
+    std::atomic<bool> stopping{false};
+    std::unique_ptr<TaskGroup> group;
+    Scheduler* pool = nullptr;
+};
+
+extern std::atomic<int64_t> ponder_hits;
+extern std::atomic<int64_t> ponder_misses;
+
+#endif // PONDER_HPP
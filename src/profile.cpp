@@ -0,0 +1,100 @@
+#include "profile.h"
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+static const char* phase_names[] = {"select", "expand", "playout", "backpropagate"};
+
+PhaseTotals PhaseTotals::operator-(PhaseTotals const& other) const {
+    PhaseTotals result;
+    for (int i = 0; i < (int)Phase::Count; i++) {
+        result.cycles[i] = cycles[i] - other.cycles[i];
+        result.calls[i] = calls[i] - other.calls[i];
+    }
+    return result;
+}
+
+#ifdef PROFILE_PHASES
+
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<PhaseCounters>> registry;
+
+PhaseCounters& register_phase_counters() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(std::make_unique<PhaseCounters>());
+    return *registry.back();
+}
+
+static void add_counters(PhaseTotals& totals, PhaseCounters const& counters) {
+    for (int i = 0; i < (int)Phase::Count; i++) {
+        totals.cycles[i] += counters.cycles[i].load(std::memory_order_relaxed);
+        totals.calls[i] += counters.calls[i].load(std::memory_order_relaxed);
+    }
+}
+
+PhaseTotals all_phase_totals() {
+    PhaseTotals totals;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& counters : registry) {
+        add_counters(totals, *counters);
+    }
+    return totals;
+}
+
+PhaseTotals thread_phase_totals() {
+    PhaseTotals totals;
+    add_counters(totals, phase_counters);
+    return totals;
+}
+
+// Measured once against the steady clock, the cycle counter runs at a
+// constant rate on every CPU this targets
+static double cycles_per_ns() {
+    static double rate = [] {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_cycles = read_cycles();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        uint64_t cycles = read_cycles() - start_cycles;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        return (double)cycles / ns;
+    }();
+    return rate;
+}
+
+#else
+
+PhaseTotals all_phase_totals() {
+    return {};
+}
+
+PhaseTotals thread_phase_totals() {
+    return {};
+}
+
+static double cycles_per_ns() {
+    return 1;
+}
+
+#endif
+
+std::string PhaseTotals::to_string() const {
+    uint64_t total = 0;
+    for (uint64_t c : cycles) {
+        total += c;
+    }
+    double rate = cycles_per_ns();
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1);
+    for (int i = 0; i < (int)Phase::Count; i++) {
+        if (i > 0) {
+            oss << ", ";
+        }
+        oss << phase_names[i] << " " << cycles[i] / rate / 1e6 << " ms " << (total ? 100.0 * cycles[i] / total : 0.0) << "% " << calls[i] << " calls "
+            << (calls[i] ? cycles[i] / rate / calls[i] : 0.0) << " ns/call";
+    }
+    return oss.str();
+}
@@ -0,0 +1,84 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Phases of an MCTS iteration. Build with PROFILE=1 to time them, otherwise
+// PhaseTimer is empty and compiles away.
+enum class Phase : uint8_t { Select, Expand, Playout, Backpropagate, Count };
+
+#ifdef PROFILE_PHASES
+constexpr bool phase_profiling = true;
+#else
+constexpr bool phase_profiling = false;
+#endif
+
+struct PhaseTotals {
+    std::array<uint64_t, (int)Phase::Count> cycles{};
+    std::array<uint64_t, (int)Phase::Count> calls{};
+
+    PhaseTotals operator-(PhaseTotals const& other) const;
+    // Time, share and cost per call of every phase
+    std::string to_string() const;
+};
+
+// Summed over every thread that ever ran a phase
+PhaseTotals all_phase_totals();
+// The calling thread's counters only
+PhaseTotals thread_phase_totals();
+
+#ifdef PROFILE_PHASES
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t read_cycles() {
+    return __rdtsc();
+}
+#else
+#include <chrono>
+inline uint64_t read_cycles() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+#endif
+
+// Each thread owns one, on cache lines of its own. Only the owner writes,
+// relaxed atomics let reports read them while searches run.
+struct alignas(64) PhaseCounters {
+    std::array<std::atomic<uint64_t>, (int)Phase::Count> cycles{};
+    std::array<std::atomic<uint64_t>, (int)Phase::Count> calls{};
+};
+
+// Counters outlive their thread, so totals survive a pool being recreated
+PhaseCounters& register_phase_counters();
+inline thread_local PhaseCounters& phase_counters = register_phase_counters();
+
+// Adds the cycles from construction to destruction to phase
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase)
+        : phase((int)phase), start(read_cycles()) {}
+    ~PhaseTimer() {
+        PhaseCounters& counters = phase_counters;
+        uint64_t cycles = read_cycles() - start;
+        counters.cycles[phase].store(counters.cycles[phase].load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+        counters.calls[phase].store(counters.calls[phase].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+private:
+    int phase;
+    uint64_t start;
+};
+
+#else
+
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase) {}
+};
+
+#endif
+
+#endif // PROFILE_HPP
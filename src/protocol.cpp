@@ -0,0 +1,284 @@
+#include "protocol.h"
+#include "batch.h"
+#include "ponder.h"
+#include "search.h"
+#include "utils.h"
+#include "value.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Time between two info lines of a running search
+constexpr auto INFO_INTERVAL = std::chrono::milliseconds(100);
+
+static std::mutex send_mutex;
+
+static void send(const std::string& line) {
+    std::lock_guard<std::mutex> lock(send_mutex);
+    std::cout << line << std::endl;
+}
+
+static void send_info(SearchInfo const& info) {
+    std::ostringstream oss;
+    oss << "info time " << info.elapsed_ms << " visits " << info.visits;
+    if (!info.children.empty()) {
+        ChildStats best = info.children.front();
+        oss << " score " << best.average_score() << " move " << best.move.to_string();
+    }
+    send(oss.str());
+}
+
+struct Session {
+    Config config;
+    Game game = Game(1);
+    bool has_position = false;
+    std::unique_ptr<SearchHandle> search;
+    // Streams info lines and the bestmove of the running search
+    std::thread reporter;
+    Ponder ponder;
+    std::vector<std::unique_ptr<MCTSNode>> pondered;
+};
+
+static void finish_search(Session& session, bool stop) {
+    if (!session.reporter.joinable()) {
+        return;
+    }
+    if (stop) {
+        session.search->stop();
+    }
+    session.reporter.join();
+    session.search.reset();
+}
+
+static bool parse_flag(const std::string& value) {
+    return value == "on" || value == "true" || value == "1";
+}
+
+static void set_option(Session& session, const std::string& name, const std::string& value) {
+    Config& config = session.config;
+    if (name == "threads") {
+        config.threads = std::clamp(std::stoi(value), 1, ensure_pool_exists(config).size());
+    } else if (name == "ms") {
+        config.ms_per_move = std::max(1, std::stoi(value));
+    } else if (name == "iterations") {
+        config.iterations = std::max<int64_t>(0, std::stoll(value));
+    } else if (name == "ponder") {
+        config.ponder = parse_flag(value);
+    } else if (name == "leaf_batch") {
+        config.leaf_batch = std::clamp(std::stoi(value), 1, MAX_BATCH);
+    } else if (name == "playout_rounds") {
+        config.playout_rounds = std::max(0, std::stoi(value));
+    } else if (name == "leaf_eval") {
+        if (value == "value" && !value_table_loaded()) {
+            std::cerr << "Error: leaf_eval value requires a value table" << std::endl;
+            return;
+        }
+        config.leaf_eval = value == "value" ? LeafEval::Value : LeafEval::Playout;
+    } else if (name == "debug") {
+        config.debug = parse_flag(value);
+    } else {
+        std::cerr << "Unknown option: " << name << std::endl;
+    }
+}
+
+// A non-negative integer of at most max, checked before it is narrowed
+static uint8_t parse_field(const std::string& token, uint32_t max, const std::string& field) {
+    uint32_t value = token.empty() || token[0] == '-' ? max + 1 : parse_uint(token);
+    if (value > max) {
+        throw std::invalid_argument(field + " must be between 0 and " + std::to_string(max) + ": " + token);
+    }
+    return value;
+}
+
+// Builds a single player game from the dice, the available rerolls and the
+// filled categories; the round is the number of filled categories
+Game parse_position(std::istringstream& iss) {
+    Game game(1);
+    Player& player = game.player();
+    bool has_dice = false;
+    std::string token;
+    iss >> token;
+    while (!iss.fail()) {
+        if (token == "dice") {
+            int total = 0;
+            for (int i = 0; i < 6; i++) {
+                if (!(iss >> token)) {
+                    throw std::invalid_argument("dice must be 6 frequencies summing to 6");
+                }
+                game.dice.dice_freq[i] = parse_field(token, 6, "dice");
+                total += game.dice.dice_freq[i];
+            }
+            if (total != 6) {
+                throw std::invalid_argument("dice must be 6 frequencies summing to 6");
+            }
+            has_dice = true;
+            iss >> token;
+        } else if (token == "rerolls") {
+            if (!(iss >> token)) {
+                throw std::invalid_argument("rerolls needs a count");
+            }
+            player.rerolls = parse_field(token, UINT8_MAX, "rerolls");
+            iss >> token;
+        } else if (token == "scores") {
+            while (iss >> token) {
+                Category category = category_from_string(token);
+                if (category == Category::Count) {
+                    break;
+                }
+                std::string score;
+                if (!(iss >> score)) {
+                    throw std::invalid_argument("missing score for " + token);
+                }
+                int i = (int)category;
+                if (player.scores[i]) {
+                    throw std::invalid_argument(token + " is scored twice");
+                }
+                game.rounds++;
+                player.scores[i] = parse_field(score, UINT8_MAX, "score");
+                player.scored_mask &= ~(1 << i);
+                // The upper section bonus counts Ones to Sixes, as in Game::play_move
+                if (i <= (int)Category::Sixes) {
+                    player.bonus_progress += player.scores[i].value();
+                }
+            }
+        } else {
+            throw std::invalid_argument("Unknown position field: " + token);
+        }
+    }
+    if (!has_dice) {
+        throw std::invalid_argument("position needs dice");
+    }
+    return game;
+}
+
+std::string position_string(Game& game) {
+    Player& player = game.player();
+    std::ostringstream oss;
+    oss << "dice";
+    for (int freq : game.dice.dice_freq) {
+        oss << " " << freq;
+    }
+    oss << " rerolls " << (int)player.rerolls << " scores";
+    for (int i = 0; i < (int)Category::Count; i++) {
+        if (player.scores[i]) {
+            oss << " " << category_to_string((Category)i) << " " << (int)player.scores[i].value();
+        }
+    }
+    return oss.str();
+}
+
+static void go(Session& session, std::istringstream& iss) {
+    Config config = session.config;
+    std::string token;
+    while (iss >> token) {
+        std::string value;
+        iss >> value;
+        if (token == "ms") {
+            config.ms_per_move = std::max(1, std::stoi(value));
+            config.iterations = 0;
+        } else if (token == "iterations") {
+            config.iterations = std::max<int64_t>(1, std::stoll(value));
+        } else {
+            throw std::invalid_argument("Unknown go limit: " + token);
+        }
+    }
+    if (!session.has_position) {
+        throw std::invalid_argument("go needs a position");
+    }
+    if (session.game.is_terminal()) {
+        send("bestmove none");
+        return;
+    }
+
+    session.search = std::make_unique<SearchHandle>(session.game, config, std::move(session.pondered));
+    session.pondered.clear();
+    session.search->start();
+    session.reporter = std::thread([&session, config] {
+        SearchHandle& search = *session.search;
+        while (!search.wait_for(INFO_INTERVAL)) {
+            send_info(search.info());
+        }
+        search.wait();
+        SearchInfo info = search.info();
+        send_info(info);
+        std::optional<Move> best = info.best_move();
+        send("bestmove " + (best ? best->to_string() : std::string("none")));
+        if (config.ponder && best) {
+            session.ponder.start(session.game, *best, config);
+        }
+    });
+}
+
+static void run_legacy(const std::string& line) {
+    std::istringstream iss(line);
+    std::vector<std::string> args = {"maxi-yahtzee"};
+    std::string arg;
+    while (iss >> arg) {
+        args.push_back(arg);
+    }
+    std::vector<char*> argv;
+    for (auto& a : args) {
+        argv.push_back(a.data());
+    }
+    run_args(argv.size(), argv.data());
+}
+
+void run_protocol(Config config, std::istream& in) {
+    // The pool is sized once, so setoption threads can go up to the cores
+    Config pool_config = config;
+    pool_config.threads = std::max<int>(config.threads, std::thread::hardware_concurrency());
+    ensure_pool_exists(pool_config);
+
+    Session session;
+    session.config = config;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream iss(line);
+        std::string cmd;
+        if (!(iss >> cmd)) {
+            continue;
+        }
+        try {
+            if (cmd == "isready") {
+                send("readyok");
+            } else if (cmd == "stop") {
+                finish_search(session, true);
+            } else if (cmd == "quit") {
+                break;
+            } else if (cmd == "position") {
+                finish_search(session, false);
+                Game game = parse_position(iss);
+                session.pondered = session.ponder.take(game);
+                session.game = game;
+                session.has_position = true;
+            } else if (cmd == "go") {
+                finish_search(session, false);
+                go(session, iss);
+            } else if (cmd == "setoption") {
+                finish_search(session, false);
+                std::string name, value;
+                iss >> name >> value;
+                set_option(session, name, value);
+            } else if (cmd[0] == '-') {
+                finish_search(session, false);
+                session.ponder.stop();
+                run_legacy(line);
+            } else if (std::all_of(cmd.begin(), cmd.end(), ::isdigit)) {
+                // A bare game count, played with the current options
+                finish_search(session, false);
+                session.ponder.stop();
+                Config games_config = session.config;
+                games_config.games = std::stoi(cmd);
+                run_games(games_config);
+            } else {
+                std::cerr << "Unknown command: " << cmd << std::endl;
+            }
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+    }
+    finish_search(session, true);
+}
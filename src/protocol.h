@@ -0,0 +1,24 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include "run.h"
+#include <istream>
+#include <sstream>
+
+// Line based engine protocol, so one process with loaded tables can answer
+// many queries. Commands:
+//   position dice <6 freqs> [rerolls <n>] [scores <category> <score> ...]
+//   setoption <name> <value>  (threads, ms, iterations, ponder, leaf_batch,
+//                              playout_rounds, leaf_eval, debug)
+//   go [ms <n>] [iterations <n>]  answers with info lines and a bestmove
+//   stop, isready, quit
+// A line of command line flags ("-g 10 -t 50 -m 4") or a bare game count
+// plays games like the command line does.
+void run_protocol(Config config, std::istream& in);
+// Parses the fields of a position command, throws std::invalid_argument
+Game parse_position(std::istringstream& iss);
+// The fields of a position command for the current player of game; a single
+// player game parses back to the same Game
+std::string position_string(Game& game);
+
+#endif // PROTOCOL_HPP
@@ -0,0 +1,318 @@
+#include "record.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+static const char RECORD_MAGIC[4] = {'M', 'Y', 'G', 'R'};
+constexpr uint8_t RECORD_VERSION = 1;
+constexpr size_t WRITE_BUFFER_SIZE = 1 << 20;
+// Far above any real game, so a corrupt length cannot ask for gigabytes
+constexpr uint64_t MAX_RECORD_SIZE = 1 << 26;
+// Fewest bytes a move or a child can be encoded in
+constexpr size_t MIN_MOVE_BYTES = 7;
+constexpr size_t MIN_CHILD_BYTES = 3;
+
+static void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static void put_freqs(std::string& out, std::array<uint8_t, 6> const& freqs) {
+    uint32_t packed = 0;
+    for (int i = 0; i < 6; i++) {
+        packed |= (uint32_t)freqs[i] << (3 * i);
+    }
+    out.push_back((char)(packed & 0xFF));
+    out.push_back((char)(packed >> 8 & 0xFF));
+    out.push_back((char)(packed >> 16));
+}
+
+// Type in the top two bits, the category in the low five
+static void put_move(std::string& out, Move const& move) {
+    switch (move.type) {
+    case Move::Type::Reroll:
+        out.push_back(0);
+        put_freqs(out, move.reroll.hold_freq);
+        break;
+    case Move::Type::Cross:
+        out.push_back((char)(1 << 6 | (int)move.crossed_category));
+        break;
+    case Move::Type::Score:
+        out.push_back((char)(2 << 6 | (int)move.score_entry.category));
+        out.push_back((char)move.score_entry.score);
+        break;
+    }
+}
+
+void encode_record(GameRecord const& record, std::string& out) {
+    std::string body;
+    body.push_back((char)record.num_players);
+    put_freqs(body, record.initial_dice.dice_freq);
+    put_varint(body, record.moves.size());
+    for (auto& move : record.moves) {
+        put_move(body, move.move);
+        put_freqs(body, move.dice.dice_freq);
+        put_varint(body, move.visits);
+        put_varint(body, move.time_ms);
+        put_varint(body, move.children.size());
+        for (auto& child : move.children) {
+            put_move(body, child.move);
+            put_varint(body, child.visits);
+            put_varint(body, child.total_score);
+        }
+    }
+    for (int i = 0; i < record.num_players; i++) {
+        put_varint(body, i < (int)record.final_scores.size() ? record.final_scores[i] : 0);
+    }
+    put_varint(out, body.size());
+    out += body;
+}
+
+// Bounds checked reads from one record's bytes
+struct RecordCursor {
+    const std::string& data;
+    size_t pos = 0;
+
+    uint8_t byte() {
+        if (pos >= data.size()) {
+            throw std::runtime_error("record truncated");
+        }
+        return data[pos++];
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("bad varint");
+    }
+
+    // A count of items of at least min_bytes each, checked against the bytes left
+    size_t count(size_t min_bytes) {
+        uint64_t value = varint();
+        if (value > (data.size() - pos) / min_bytes) {
+            throw std::runtime_error("bad record count");
+        }
+        return value;
+    }
+
+    std::array<uint8_t, 6> freqs(int max_total) {
+        uint32_t packed = byte();
+        packed |= (uint32_t)byte() << 8;
+        packed |= (uint32_t)byte() << 16;
+        std::array<uint8_t, 6> freqs;
+        int total = 0;
+        for (int i = 0; i < 6; i++) {
+            freqs[i] = packed >> (3 * i) & 7;
+            total += freqs[i];
+        }
+        if (total > max_total) {
+            throw std::runtime_error("bad dice frequencies");
+        }
+        return freqs;
+    }
+
+    Dice dice() {
+        return Dice(freqs(6));
+    }
+
+    Move move() {
+        uint8_t head = byte();
+        int type = head >> 6;
+        int category = head & 0x1F;
+        Move move;
+        if (type == 0) {
+            move.type = Move::Type::Reroll;
+            move.reroll.hold_freq = freqs(6);
+            int held = 0;
+            for (uint8_t f : move.reroll.hold_freq) {
+                held += f;
+            }
+            move.reroll.num_rolls = 6 - held;
+            return move;
+        }
+        if (type > 2 || category >= (int)Category::Count) {
+            throw std::runtime_error("bad move");
+        }
+        if (type == 1) {
+            move.type = Move::Type::Cross;
+            move.crossed_category = (Category)category;
+        } else {
+            move.type = Move::Type::Score;
+            move.score_entry.category = (Category)category;
+            move.score_entry.score = byte();
+        }
+        return move;
+    }
+};
+
+bool decode_record(std::istream& in, GameRecord& record) {
+    uint64_t size = 0;
+    for (int shift = 0;; shift += 7) {
+        int c = in.get();
+        if (c == EOF) {
+            if (shift == 0) {
+                return false;
+            }
+            throw std::runtime_error("record truncated");
+        }
+        size |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            break;
+        }
+        if (shift > 28) {
+            throw std::runtime_error("bad record length");
+        }
+    }
+    if (size > MAX_RECORD_SIZE) {
+        throw std::runtime_error("bad record length");
+    }
+    std::string data(size, '\0');
+    if (!in.read(data.data(), size)) {
+        throw std::runtime_error("record truncated");
+    }
+
+    RecordCursor cursor{data};
+    record.num_players = cursor.byte();
+    record.initial_dice = cursor.dice();
+    record.moves.resize(cursor.count(MIN_MOVE_BYTES));
+    for (auto& move : record.moves) {
+        move.move = cursor.move();
+        move.dice = cursor.dice();
+        move.visits = cursor.varint();
+        move.time_ms = cursor.varint();
+        move.children.resize(cursor.count(MIN_CHILD_BYTES));
+        for (auto& child : move.children) {
+            child.move = cursor.move();
+            child.visits = cursor.varint();
+            child.total_score = cursor.varint();
+        }
+    }
+    record.final_scores.resize(record.num_players);
+    for (auto& score : record.final_scores) {
+        score = cursor.varint();
+    }
+    return true;
+}
+
+RecordWriter::RecordWriter(const std::string& path)
+    : buffer(WRITE_BUFFER_SIZE) {
+    std::error_code ec;
+    bool fresh = !std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0;
+    file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    file.open(path, std::ios::binary | std::ios::app);
+    if (fresh && file) {
+        file.write(RECORD_MAGIC, sizeof(RECORD_MAGIC));
+        file.put(RECORD_VERSION);
+    }
+    thread = std::thread(&RecordWriter::writer_loop, this);
+}
+
+RecordWriter::~RecordWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    queue_cv.notify_one();
+    thread.join();
+}
+
+bool RecordWriter::is_open() const {
+    return file.is_open();
+}
+
+void RecordWriter::write(GameRecord const& record) {
+    std::string bytes;
+    encode_record(record, bytes);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(bytes));
+    }
+    queue_cv.notify_one();
+}
+
+void RecordWriter::writer_loop() {
+    std::vector<std::string> pending;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_cv.wait(lock, [this] {
+                return closing || !queue.empty();
+            });
+            if (queue.empty() && closing) {
+                break;
+            }
+            pending.swap(queue);
+        }
+        for (auto& bytes : pending) {
+            file.write(bytes.data(), bytes.size());
+        }
+        pending.clear();
+    }
+    file.flush();
+}
+
+int replay_records(const std::string& path, bool verbose) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(RECORD_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), RECORD_MAGIC)) {
+        std::cerr << "Error: " << path << " is not a game record file" << std::endl;
+        return -1;
+    }
+    if (in.get() != RECORD_VERSION) {
+        std::cerr << "Error: unsupported record version" << std::endl;
+        return -1;
+    }
+
+    int64_t games = 0;
+    int64_t moves = 0;
+    int64_t total_score = 0;
+    int mismatches = 0;
+    GameRecord record;
+    try {
+        while (decode_record(in, record)) {
+            Game game(record.num_players);
+            game.dice = record.initial_dice;
+            bool valid = true;
+            for (auto& move : record.moves) {
+                uint32_t open = game.player().scored_mask;
+                if (game.is_terminal()
+                    || (move.move.type == Move::Type::Score && !(open & 1 << (int)move.move.score_entry.category))
+                    || (move.move.type == Move::Type::Cross && !(open & 1 << (int)move.move.crossed_category))
+                    || (move.move.type == Move::Type::Reroll && game.player().rerolls == 0)) {
+                    valid = false;
+                    break;
+                }
+                if (verbose) {
+                    std::cout << game.dice.to_string() << "| " << move.move.to_string() << " | " << move.visits << " visits " << move.time_ms << " ms" << std::endl;
+                }
+                game.play_move(move.move, move.dice);
+            }
+            for (int i = 0; i < record.num_players && valid; i++) {
+                valid = game.players[i].total_score() == record.final_scores[i];
+            }
+            if (!valid) {
+                std::cerr << "Record " << games << " does not replay to its final scores" << std::endl;
+                mismatches++;
+            }
+            games++;
+            moves += record.moves.size();
+            total_score += record.final_scores[0];
+        }
+    } catch (std::exception const& e) {
+        std::cerr << "Error: record " << games << ": " << e.what() << std::endl;
+        mismatches++;
+    }
+
+    std::cout << games << " games, " << moves << " moves, average score " << (games ? (double)total_score / games : 0) << ", " << mismatches << " mismatches" << std::endl;
+    return mismatches;
+}
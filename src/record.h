@@ -0,0 +1,68 @@
+#ifndef RECORD_HPP
+#define RECORD_HPP
+
+#include "game.h"
+#include "search.h"
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One move of a recorded game with the search behind it
+struct MoveRecord {
+    Move move;
+    // Dice after the move: the reroll result or the next turn's roll
+    Dice dice;
+    uint64_t visits = 0;
+    uint32_t time_ms = 0;
+    std::vector<ChildStats> children;
+};
+
+struct GameRecord {
+    uint8_t num_players = 1;
+    Dice initial_dice;
+    std::vector<MoveRecord> moves;
+    std::vector<int> final_scores;
+};
+
+// A record file is a "MYGR" magic and a version, followed by records that
+// each start with their byte length. Dice and reroll holds are six 3-bit
+// frequencies in 3 bytes, counts and scores are LEB128 varints.
+void encode_record(GameRecord const& record, std::string& out);
+// False at the end of the stream, throws std::runtime_error on bad data
+bool decode_record(std::istream& in, GameRecord& record);
+
+// Appends records to a file from a background thread. write() only encodes
+// and queues, so game threads never wait on the disk.
+class RecordWriter {
+public:
+    explicit RecordWriter(const std::string& path);
+    // Writes everything still queued
+    ~RecordWriter();
+    RecordWriter(const RecordWriter&) = delete;
+    RecordWriter& operator=(const RecordWriter&) = delete;
+
+    bool is_open() const;
+    void write(GameRecord const& record);
+
+private:
+    void writer_loop();
+
+    std::ofstream file;
+    std::vector<char> buffer;
+    std::vector<std::string> queue;
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    bool closing = false;
+    std::thread thread;
+};
+
+// Replays every record in path through Game::play_move and checks the
+// recorded final scores; returns the number of records that didn't match
+int replay_records(const std::string& path, bool verbose);
+
+#endif // RECORD_HPP
@@ -1,46 +1,64 @@
 #include "run.h"
+#include "allocations.h"
+#include "analyze.h"
+#include "batch.h"
+#include "corpus.h"
+#include "match.h"
 #include "mcts.h"
+#include "placement.h"
+#include "ponder.h"
+#include "profile.h"
+#include "protocol.h"
+#include "record.h"
+#include "server.h"
+#include "scheduler.h"
+#include "search.h"
+#include "sweep.h"
+#include "trace.h"
+#include "value.h"
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
+#include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <sstream>
 #include <thread>
 
 extern thread_local uint32_t rng_state;
 
-int64_t visits = 0;
-int64_t milliseconds = 0;
+std::atomic<int64_t> visits = 0;
+std::atomic<int64_t> milliseconds = 0;
 float average_score = 0;
+static int games_played = 0;
+static std::mutex output_mutex;
 
-static std::vector<std::thread> pool;
-static std::queue<std::function<void()>> tasks;
-static std::mutex pool_mutex;
-static std::condition_variable pool_cv;
-static bool pool_stop = false;
+static std::unique_ptr<Scheduler> scheduler;
+static std::mutex scheduler_mutex;
+// Set by --record, every finished game is appended to it
+static std::unique_ptr<RecordWriter> record_writer;
 
-static void ensure_pool_exists(int num_threads) {
-    if (!pool.empty())
-        return;
-    for (int i = 0; i < num_threads; i++) {
-        pool.emplace_back([] {
-            while (true) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(pool_mutex);
-                    pool_cv.wait(lock, [] {
-                        return pool_stop || !tasks.empty();
-                    });
-                    if (pool_stop && tasks.empty())
-                        return;
-                    task = std::move(tasks.front());
-                    tasks.pop();
-                }
-                task();
-            }
-        });
+Scheduler& ensure_pool_exists(Config const& config) {
+    // Never resized: workers may be running ponder tasks, and searches and
+    // ponderers keep pointers to the pool
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    if (!scheduler) {
+        if (config.pin || config.numa) {
+            init_placement(config.threads, config.pin, config.numa);
+            std::cout << placement_report() << std::endl;
+            scheduler = std::make_unique<Scheduler>(config.threads, apply_worker_placement);
+        } else {
+            scheduler = std::make_unique<Scheduler>(config.threads);
+        }
     }
+    return *scheduler;
+}
+
+void shutdown_pool() {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    scheduler.reset();
 }
 
 void print_usage(char* prog_name) {
@@ -49,23 +67,158 @@ void print_usage(char* prog_name) {
               << "  -g <int>    Number of games (required)\n"
               << "  -m <int>    Milliseconds per move (required)\n"
               << "  -t <int>    Number of threads (default: 1)\n"
-              << "  -d          Enable debug mode\n";
+              << "  -i <int>    Iterations per move instead of a time limit\n"
+              << "  -d          Enable debug mode\n"
+              << "  --pin       Pin pool workers to cores\n"
+              << "  --numa      Replicate playout tables per NUMA node and keep worker memory local\n"
+              << "  -c          Play games concurrently, one single-threaded search per game\n"
+              << "  --ponder    Keep searching the likely next positions between moves\n"
+              << "  --tree-stats  Print a JSON line of search tree statistics after every move\n"
+              << "  -k <int>    Playouts per expanded leaf (default: 1)\n"
+              << "  -v          Evaluate leaves with the value table\n"
+              << "  -r <int>    Playout rounds before the leaf is estimated (default: 0, full playouts)\n"
+              << "  --match <flags>      Play -g seeded game pairs against an engine with these flags\n"
+              << "                       changed, e.g. \"-k 4\", and stop once an SPRT decides\n"
+              << "  --sprt-delta <float> Score difference the SPRT tests for (default: 1)\n"
+              << "  --sweep <ms,ms,...>  Search seeded positions with 1, 2, 4, ... up to -m threads for\n"
+              << "                       every budget and report the scaling\n"
+              << "  --corpus <file>      Sweep over the positions and reference moves of a corpus\n"
+              << "  --make-corpus <file> Write a corpus of seeded positions searched with -t/-i and -m\n"
+              << "  --positions <int>    Positions sampled by --sweep and --make-corpus (default: 24)\n"
+              << "  --trace <file>       Write a Chrome trace-event timeline of every thread at exit\n"
+              << "  --seed <int>         Seed of the match dice and sampled positions (default: 1)\n"
+              << "  --train-value <int>  Train the value table on <int> playout games\n"
+              << "  --analyze <file>     Analyse the positions in <file> (- for stdin) and exit\n"
+              << "  --serve <socket>     Serve analysis requests on a Unix domain socket\n"
+              << "  --record <file>      Append every played game to a binary record file\n"
+              << "  --replay <file>      Replay and check a record file, -d prints every move\n"
+              << "Without options, commands are read from stdin (see protocol.h).\n";
+}
+
+// Flags that change how a move is searched, shared by the engines of a match
+static bool parse_engine_flag(Config& config, int argc, char* argv[], int& i) {
+    std::string arg = argv[i];
+    if (arg == "-t" && i + 1 < argc) {
+        config.ms_per_move = std::stoi(argv[++i]);
+    } else if (arg == "-m" && i + 1 < argc) {
+        config.threads = std::stoi(argv[++i]);
+    } else if (arg == "-i" && i + 1 < argc) {
+        config.iterations = std::stoll(argv[++i]);
+    } else if (arg == "-k" && i + 1 < argc) {
+        config.leaf_batch = std::clamp(std::stoi(argv[++i]), 1, MAX_BATCH);
+    } else if (arg == "-v") {
+        config.leaf_eval = LeafEval::Value;
+    } else if (arg == "-r" && i + 1 < argc) {
+        config.playout_rounds = std::stoi(argv[++i]);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Applies the engine flags in a --match argument on top of config
+static bool parse_engine_flags(Config& config, const std::string& flags) {
+    std::istringstream iss(flags);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (iss >> token) {
+        tokens.push_back(token);
+    }
+    std::vector<char*> args;
+    for (auto& t : tokens) {
+        args.push_back(t.data());
+    }
+    for (int i = 0; i < (int)args.size(); i++) {
+        // Match games run one single-threaded search per pool worker
+        if (std::string(args[i]) == "-m") {
+            std::cerr << "Error: -m is not supported in --match, match searches are single-threaded" << std::endl;
+            return false;
+        }
+        if (!parse_engine_flag(config, args.size(), args.data(), i)) {
+            std::cerr << "Error: not an engine flag in --match: " << args[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
 void run_args(int argc, char* argv[]) {
     Config config;
+    bool match = false;
+    std::string match_flags;
+    MatchOptions match_options;
+    bool sweep = false;
+    SweepOptions sweep_options;
+    std::string corpus_path;
+    std::string analyze_path;
+    std::string replay_path;
+    std::string socket_path;
+
+    if (argc == 1) {
+        run_protocol(config, std::cin);
+        return;
+    }
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
 
+        if (parse_engine_flag(config, argc, argv, i)) {
+            continue;
+        }
         if (arg == "-g" && i + 1 < argc) {
             config.games = std::stoi(argv[++i]);
-        } else if (arg == "-t" && i + 1 < argc) {
-            config.ms_per_move = std::stoi(argv[++i]);
-        } else if (arg == "-m" && i + 1 < argc) {
-            config.threads = std::stoi(argv[++i]);
         } else if (arg == "-d") {
             config.debug = true;
+        } else if (arg == "--pin") {
+            config.pin = true;
+        } else if (arg == "--numa") {
+            config.numa = true;
+        } else if (arg == "--ponder") {
+            config.ponder = true;
+        } else if (arg == "--tree-stats") {
+            config.tree_stats = true;
+        } else if (arg == "-c") {
+            config.concurrent = true;
+        } else if (arg == "--match" && i + 1 < argc) {
+            match_flags = argv[++i];
+            match = true;
+        } else if (arg == "--sprt-delta" && i + 1 < argc) {
+            match_options.delta = std::stod(argv[++i]);
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            sweep = true;
+            sweep_options.ms_per_move.clear();
+            std::istringstream iss(argv[++i]);
+            std::string ms;
+            while (std::getline(iss, ms, ',')) {
+                sweep_options.ms_per_move.push_back(std::max(1, std::stoi(ms)));
+            }
+        } else if (arg == "--corpus" && i + 1 < argc) {
+            sweep_options.corpus = argv[++i];
+            sweep = true;
+        } else if (arg == "--make-corpus" && i + 1 < argc) {
+            corpus_path = argv[++i];
+        } else if (arg == "--positions" && i + 1 < argc) {
+            sweep_options.positions = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--trace" && i + 1 < argc) {
+            start_tracing(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            match_options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--analyze" && i + 1 < argc) {
+            analyze_path = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_writer = std::make_unique<RecordWriter>(argv[++i]);
+            if (!record_writer->is_open()) {
+                std::cerr << "Error: cannot open " << argv[i] << std::endl;
+                record_writer.reset();
+                return;
+            }
+        } else if (arg == "--serve" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (arg == "--train-value" && i + 1 < argc) {
+            train_value_table(std::stoi(argv[++i]));
+            return;
         } else {
             std::cerr << "Unknown or incomplete argument: " << arg << std::endl;
             print_usage(argv[0]);
@@ -73,94 +226,221 @@ void run_args(int argc, char* argv[]) {
         }
     }
 
+    Config test = config;
+    if (match && !parse_engine_flags(test, match_flags)) {
+        return;
+    }
+    if ((config.leaf_eval == LeafEval::Value || test.leaf_eval == LeafEval::Value) && !value_table_loaded()) {
+        std::cerr << "Error: -v requires a value table, train one with --train-value.\n";
+        return;
+    }
+
+    if (!replay_path.empty()) {
+        replay_records(replay_path, config.debug);
+        return;
+    }
+
+    if (!socket_path.empty()) {
+        run_server(config, socket_path);
+        return;
+    }
+
+    if (!analyze_path.empty()) {
+        if (analyze_path == "-") {
+            run_analysis(config, std::cin);
+            return;
+        }
+        std::ifstream ifs(analyze_path);
+        if (!ifs) {
+            std::cerr << "Error: cannot open " << analyze_path << std::endl;
+            return;
+        }
+        run_analysis(config, ifs);
+        return;
+    }
+
+    if (!corpus_path.empty()) {
+        make_corpus(config, corpus_path, sweep_options.positions, match_options.seed);
+        return;
+    }
+
+    if (sweep && !sweep_options.ms_per_move.empty()) {
+        sweep_options.seed = match_options.seed;
+        run_sweep(config, sweep_options);
+        return;
+    }
+
+    if (match) {
+        run_match(config, test, match_options);
+        return;
+    }
+
     if (config.games <= 0 || config.ms_per_move <= 0) {
         std::cerr << "Error: Games and ms_per_move are required and must be positive.\n";
         print_usage(argv[0]);
         return;
     }
 
+    config.threads = std::min(config.threads, ensure_pool_exists(config).size());
     std::cout << "Running " << config.games << " games on " << config.threads << " threads with " << config.ms_per_move << "ms per move..." << std::endl;
     run_games(config);
+    // Flushes the records before returning, e.g. to the protocol loop
+    record_writer.reset();
+}
+
+// A single-threaded search on a worker, e.g. a concurrent game, runs only
+// there; otherwise every thread's phases belong to the current search
+static PhaseTotals search_phase_totals(Config const& config) {
+    return config.threads == 1 && Scheduler::worker_index() >= 0 ? thread_phase_totals() : all_phase_totals();
+}
+
+static AllocationCounts search_allocations(Config const& config) {
+    return config.threads == 1 && Scheduler::worker_index() >= 0 ? thread_allocations() : all_allocations();
+}
+
+static void report_game(int score) {
+    games_played++;
+    average_score = average_score + ((float)score - average_score) / games_played;
+
+    std::cout << "Average score: " << average_score << std::endl;
+    std::cout << "Games played: " << games_played << std::endl << std::endl;
+}
+
+// Every game is one task running a single-threaded search, so the pool stays
+// busy without synchronizing on every move.
+static void run_games_concurrent(Config config) {
+    Scheduler& pool = ensure_pool_exists(config);
+    Config game_config = config;
+    game_config.threads = 1;
+    // Every worker already runs a game, there is no idle time to ponder in
+    game_config.ponder = false;
+
+    TaskGroup group;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < config.games; i++) {
+        pool.submit(
+            [i, game_config]() {
+                std::optional<TraceScope> setup("setup");
+                rng_state = std::hash<std::thread::id>{}(std::this_thread::get_id()) ^ (i * 2654435761u);
+
+                Game game = Game(1);
+                game.dice = Dice({1, 1, 4, 0, 0, 0});
+                setup.reset();
+                run_game(game, game_config);
+
+                std::lock_guard<std::mutex> lock(output_mutex);
+                report_game(game.players[0].total_score());
+            },
+            group);
+    }
+    pool.wait(group);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << config.games << " games in " << seconds << " s = " << (int64_t)(config.games / seconds * 3600) << " games/hour" << std::endl;
 }
 
 void run_games(Config config) {
+    if (config.concurrent) {
+        run_games_concurrent(config);
+        return;
+    }
     for (int i = 0; i < config.games; i++) {
+        std::optional<TraceScope> setup("setup");
         Game game = Game(1);
         game.dice = Dice({1, 1, 4, 0, 0, 0});
+        setup.reset();
         run_game(game, config);
-        int score = game.players[0].total_score();
-        average_score = average_score + ((float)score - average_score) / (i + 1);
-
-        std::cout << "Average score: " << average_score << std::endl;
-        std::cout << "Games played: " << i + 1 << std::endl << std::endl;
+        report_game(game.players[0].total_score());
     }
 }
 
 void run_game(Game& game, Config config) {
+    TraceScope trace("game");
+    Ponder ponder;
+    std::vector<std::unique_ptr<MCTSNode>> roots;
+    GameRecord record;
+    record.num_players = game.players.size();
+    record.initial_dice = game.dice;
+    PhaseTotals game_phases = search_phase_totals(config);
+    AllocationCounts game_allocations = search_allocations(config);
+    int64_t game_visits = visits;
     while (!game.is_terminal()) {
-        Move move = run_mcts(game, config);
+        SearchInfo info;
+        Move move = run_mcts(game, config, std::move(roots), record_writer ? &info : nullptr);
+        if (config.ponder) {
+            ponder.start(game, move, config);
+        }
         game.play_move(move);
+        if (config.ponder) {
+            roots = ponder.take(game);
+        }
+        if (record_writer) {
+            record.moves.push_back({move, game.dice, info.visits, (uint32_t)info.elapsed_ms, std::move(info.children)});
+        }
+    }
+    if (record_writer) {
+        for (auto& player : game.players) {
+            record.final_scores.push_back(player.total_score());
+        }
+        record_writer->write(record);
     }
     int score = game.players[0].total_score();
     int64_t vps = (float)visits / ((float)milliseconds / 1000);
+
+    std::lock_guard<std::mutex> lock(output_mutex);
     std::cout << game.scores_string() << std::endl;
     std::cout << score << " " << vps << std::endl;
     std::cout << visits << " visits / " << milliseconds << " ms = " << vps << " vps" << std::endl;
-}
-
-Move run_mcts(Game& game, Config config) {
-    ensure_pool_exists(config.threads);
-
-    std::vector<std::unique_ptr<MCTSNode>> thread_roots;
-    std::atomic<int> completed_tasks{0};
-    auto duration = std::chrono::milliseconds(config.ms_per_move);
-
-    for (int i = 0; i < config.threads; i++) {
-        auto node_ptr = std::make_unique<MCTSNode>(game);
-        MCTSNode* raw_node_ptr = node_ptr.get();
-        thread_roots.push_back(std::move(node_ptr));
-
-        {
-            std::lock_guard<std::mutex> lock(pool_mutex);
-            tasks.push([raw_node_ptr, duration, &completed_tasks]() {
-                rng_state = std::hash<std::thread::id>{}(std::this_thread::get_id());
-
-                auto start = std::chrono::steady_clock::now();
-                while (std::chrono::steady_clock::now() - start < duration) {
-                    raw_node_ptr->run_iteration();
-                }
-                completed_tasks++;
-            });
-        }
-        pool_cv.notify_one();
+    if (config.ponder) {
+        std::cout << "ponder: " << ponder_hits << " hits, " << ponder_misses << " misses" << std::endl;
     }
-
-    while (completed_tasks < config.threads) {
-        std::this_thread::yield();
+    if (allocation_counting) {
+        AllocationCounts counts = search_allocations(config) - game_allocations;
+        // Approximate with -c, where the games share the visit count
+        double played = std::max<int64_t>(1, visits - game_visits);
+        std::cout << "game allocations: " << counts.allocations << " (" << counts.bytes << " bytes), " << counts.allocations / played << " per visit, " << counts.bytes / played << " bytes per visit"
+                  << std::endl;
     }
+    if (phase_profiling) {
+        std::cout << "game phases: " << (search_phase_totals(config) - game_phases).to_string() << std::endl;
+    }
+}
 
-    MCTSNode* total = thread_roots.back().get();
-    for (int i = 0; i < config.threads - 1; i++) {
-        MCTSNode* root = thread_roots[i].get();
-        total->visits += root->visits;
-        total->total_score += root->total_score;
-
-        for (auto& child : root->children) {
-            for (auto& total_child : total->children) {
-                if (child->move.value() == total_child->move.value()) {
-                    total_child->visits += child->visits;
-                    total_child->total_score += child->total_score;
-                }
-            }
-        }
+Move run_mcts(Game& game, Config config, std::vector<std::unique_ptr<MCTSNode>> thread_roots, SearchInfo* info_out) {
+    PhaseTotals move_phases = search_phase_totals(config);
+    SearchHandle search(game, config, std::move(thread_roots));
+    if (config.threads == 1 && Scheduler::worker_index() >= 0) {
+        // Already on a worker, e.g. one game per task in concurrent mode
+        search.run();
+    } else {
+        search.start();
+        TraceScope trace("wait");
+        search.wait();
     }
+    SearchInfo info = search.info();
 
-    visits += total->visits;
-    milliseconds += duration.count();
+    // Visits already in reused roots don't count towards this move's rate
+    visits += info.visits - search.reused_visits();
+    milliseconds += info.elapsed_ms;
     if (config.debug) {
+        if (search.reused_visits() > 0) {
+            std::cout << "reused " << search.reused_visits() << " pondered visits" << std::endl;
+        }
         std::cout << game.dice.to_string() << std::endl;
-        std::cout << total->children_string() << std::endl;
-        std::cout << total->children[0]->move.value().to_string() << std::endl;
+        std::cout << info.to_string() << std::endl;
+        std::cout << info.best_move().value().to_string() << std::endl;
+        if (phase_profiling) {
+            std::cout << "move phases: " << (search_phase_totals(config) - move_phases).to_string() << std::endl;
+        }
+    }
+    if (config.tree_stats) {
+        std::string json = search.tree_stats(info).to_json();
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cout << json << std::endl;
+    }
+    Move best = info.best_move().value();
+    if (info_out) {
+        *info_out = std::move(info);
     }
-    return total->children[0]->move.value();
+    return best;
 }
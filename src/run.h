@@ -1,13 +1,52 @@
+#ifndef RUN_HPP
+#define RUN_HPP
+
 #include "game.h"
+#include <memory>
+#include <vector>
+
+class Scheduler;
+struct MCTSNode;
+struct SearchInfo;
+
+enum class LeafEval { Playout, Value };
 
 struct Config {
     int games = 1000;
     int ms_per_move = 10;
+    // Fixed number of iterations per move instead of ms_per_move, 0 = off
+    int64_t iterations = 0;
     int threads = 8;
     bool debug = false;
+    // Run games in parallel instead of parallelizing each search
+    bool concurrent = false;
+    // Pin pool workers to cores / place tables and trees per NUMA node
+    bool pin = false;
+    bool numa = false;
+    LeafEval leaf_eval = LeafEval::Playout;
+    // Rounds simulated before the leaf is scored by the value table, or by
+    // the per-category completion values when playing out (0 = full playout)
+    int playout_rounds = 0;
+    // Playouts run from every expanded leaf
+    int leaf_batch = 1;
+    // Search the likely next positions while waiting for the actual one
+    bool ponder = false;
+    // Print a JSON line of tree statistics after every search
+    bool tree_stats = false;
 };
 
 void run_args(int argc, char* argv[]);
 void run_games(Config config);
 void run_game(Game& game, Config config);
-Move run_mcts(Game& game, Config config);
+// Searches from the given per-thread roots when there is one for every
+// thread (e.g. grown while pondering), otherwise from fresh roots. The final
+// root statistics are copied to info_out when given.
+Move run_mcts(Game& game, Config config, std::vector<std::unique_ptr<MCTSNode>> thread_roots = {}, SearchInfo* info_out = nullptr);
+// The shared search pool, created on first use with config.threads workers
+// and never resized; searches use at most one thread per worker
+Scheduler& ensure_pool_exists(Config const& config);
+// Runs the queued tasks and joins the pool's workers, so nothing records or
+// prints after the run; call once no search or ponderer is left
+void shutdown_pool();
+
+#endif // RUN_HPP
@@ -0,0 +1,159 @@
+#include "scheduler.h"
+
+static thread_local int current_worker = -1;
+static thread_local const Scheduler* current_scheduler = nullptr;
+
+// The counter is only touched under the mutex, so a waiter that sees it reach
+// zero can destroy the group without racing the last done()
+void TaskGroup::add(int count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += count;
+}
+
+bool TaskGroup::done() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending--;
+    if (pending == 0) {
+        done_cv.notify_all();
+        return true;
+    }
+    return false;
+}
+
+bool TaskGroup::finished() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending == 0;
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] {
+        return pending == 0;
+    });
+}
+
+Scheduler::Scheduler(int num_threads, std::function<void(int)> on_start) {
+    for (int i = 0; i < num_threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([this, i, on_start] {
+            if (on_start) {
+                on_start(i);
+            }
+            worker_loop(i);
+        });
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stop = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+int Scheduler::size() const {
+    return threads.size();
+}
+
+int Scheduler::worker_index() {
+    return current_worker;
+}
+
+void Scheduler::submit(std::function<void()> task, TaskGroup& group) {
+    group.add();
+    // Workers push onto their own deque, everyone else spreads round robin
+    int index = current_scheduler == this ? current_worker : next_worker++ % workers.size();
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->jobs.push_back({std::move(task), &group});
+    }
+    queued++;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    sleep_cv.notify_one();
+}
+
+bool Scheduler::pop(int index, Job& job) {
+    Worker& worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.jobs.empty()) {
+        return false;
+    }
+    job = std::move(worker.jobs.back());
+    worker.jobs.pop_back();
+    queued--;
+    return true;
+}
+
+bool Scheduler::steal(int index, Job& job) {
+    int num_workers = workers.size();
+    for (int i = 1; i <= num_workers; i++) {
+        Worker& victim = *workers[(index + i) % num_workers];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::run(Job& job) {
+    job.task();
+    if (job.group->done()) {
+        // Wakes workers sleeping in wait() on this group
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        sleep_cv.notify_all();
+    }
+}
+
+void Scheduler::worker_loop(int index) {
+    current_worker = index;
+    current_scheduler = this;
+    while (true) {
+        Job job;
+        if (pop(index, job) || steal(index, job)) {
+            run(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [this] {
+            return stop || queued > 0;
+        });
+        if (stop && queued == 0) {
+            return;
+        }
+    }
+}
+
+void Scheduler::wait(TaskGroup& group) {
+    if (current_scheduler != this) {
+        group.wait();
+        return;
+    }
+    while (!group.finished()) {
+        Job job;
+        if (pop(current_worker, job) || steal(current_worker, job)) {
+            run(job);
+            continue;
+        }
+        // The group's last task runs elsewhere; sleep until it finishes or
+        // there is something to steal. run() notifies under sleep_mutex
+        // after the group finished, so the wakeup can't be missed.
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [this, &group] {
+            return queued > 0 || group.finished();
+        });
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the outstanding tasks of one batch of work so the submitter can
+// block until all of them have run.
+class TaskGroup {
+public:
+    void add(int count = 1);
+    // Returns whether this was the last outstanding task
+    bool done();
+    bool finished();
+    // Blocks without spinning
+    void wait();
+
+private:
+    int pending = 0;
+    std::mutex mutex;
+    std::condition_variable done_cv;
+};
+
+// Thread pool with one deque per worker. Workers run their own tasks LIFO and
+// steal from the front of other workers' deques when they run dry; idle
+// workers sleep on a condition variable.
+class Scheduler {
+public:
+    // on_start runs first on every worker, with the worker index
+    explicit Scheduler(int num_threads, std::function<void(int)> on_start = nullptr);
+    ~Scheduler();
+
+    void submit(std::function<void()> task, TaskGroup& group);
+    // On a worker this runs queued tasks until the group finished, so tasks
+    // may wait on groups of their own, and sleeps while there are none;
+    // other threads block.
+    void wait(TaskGroup& group);
+    int size() const;
+    // Index of the calling worker, or -1 outside the pool
+    static int worker_index();
+
+private:
+    struct Job {
+        std::function<void()> task;
+        TaskGroup* group;
+    };
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    bool pop(int index, Job& job);
+    bool steal(int index, Job& job);
+    void run(Job& job);
+    void worker_loop(int index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<int> queued{0};
+    std::atomic<unsigned> next_worker{0};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool stop = false;
+};
+
+#endif // SCHEDULER_HPP
@@ -0,0 +1,301 @@
+#include "search.h"
+#include "trace.h"
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+extern thread_local uint32_t rng_state;
+
+// Iterations between two snapshots of a thread's root statistics
+constexpr int PUBLISH_INTERVAL = 256;
+
+using clock_type = std::chrono::steady_clock;
+
+double ChildStats::average_score() const {
+    return visits ? (double)total_score / visits : 0;
+}
+
+std::optional<Move> SearchInfo::best_move() const {
+    if (children.empty()) {
+        return std::nullopt;
+    }
+    return children.front().move;
+}
+
+std::string SearchInfo::to_string() const {
+    std::ostringstream oss;
+    for (ChildStats child : children) {
+        oss << "Visits: " << child.visits << " | Average Score: " << std::fixed << std::setprecision(4) << child.average_score() << " | Move: " << child.move.to_string() << "\n";
+    }
+    return oss.str();
+}
+
+SearchHandle::SearchHandle(Game const& game, Config const& config, std::vector<std::unique_ptr<MCTSNode>> roots)
+    : config(config), budget(std::chrono::milliseconds(config.ms_per_move)) {
+    this->config.threads = std::clamp(config.threads, 1, ensure_pool_exists(config).size());
+    bool reuse = (int)roots.size() == this->config.threads;
+    for (int i = 0; i < this->config.threads; i++) {
+        auto lane = std::make_unique<Lane>();
+        if (reuse) {
+            lane->root = std::move(roots[i]);
+            reused += lane->root->visits;
+        } else {
+            lane->root = std::make_unique<MCTSNode>(game);
+        }
+        lanes.push_back(std::move(lane));
+    }
+}
+
+SearchHandle::~SearchHandle() {
+    stop();
+    wait();
+    TraceScope trace("teardown");
+    lanes.clear();
+}
+
+bool SearchHandle::should_stop(Lane const& lane) {
+    if (stop_source.stop_requested()) {
+        return true;
+    }
+    if (config.iterations > 0) {
+        // The budget is split evenly over the lanes
+        return lane.iterations * lanes.size() >= (uint64_t)config.iterations;
+    }
+    return clock_type::now().time_since_epoch().count() >= deadline.load(std::memory_order_relaxed);
+}
+
+void SearchHandle::start_clock() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+    auto now = clock_type::now();
+    started = now.time_since_epoch().count();
+    deadline = (now + budget).time_since_epoch().count();
+}
+
+void SearchHandle::publish(Lane& lane) {
+    std::lock_guard<std::mutex> lock(lane.mutex);
+    lane.visits = lane.root->visits;
+    lane.children.resize(lane.root->children.size());
+    for (size_t i = 0; i < lane.root->children.size(); i++) {
+        MCTSNode* child = lane.root->children[i].get();
+        lane.children[i] = {child->move.value(), child->visits, child->total_score};
+    }
+}
+
+void SearchHandle::search(Lane& lane) {
+    TraceScope trace("search");
+    start_clock();
+    int since_publish = 0;
+    while (true) {
+        // At least one iteration, so even a search stopped right away has a move
+        if (lane.iterations > 0 && should_stop(lane)) {
+            publish(lane);
+            // Rechecked under the mutex so a concurrent extend() either keeps
+            // this lane going or sees it finished and restarts it
+            std::unique_lock<std::mutex> lock(mutex);
+            if (should_stop(lane)) {
+                bool last = --active == 0;
+                if (last) {
+                    finished_cv.notify_all();
+                }
+                lock.unlock();
+                // The task hasn't finished its group yet, so wait() still
+                // keeps the handle alive while the callback runs
+                if (last && finished_callback) {
+                    finished_callback();
+                }
+                return;
+            }
+        }
+        lane.root->run_iteration(config);
+        lane.iterations++;
+        if (++since_publish == PUBLISH_INTERVAL) {
+            publish(lane);
+            since_publish = 0;
+        }
+    }
+}
+
+void SearchHandle::submit_lanes() {
+    active = lanes.size();
+    for (size_t i = 0; i < lanes.size(); i++) {
+        Lane* lane = lanes[i].get();
+        pool->submit(
+            [this, lane]() {
+                rng_state = std::hash<std::thread::id>{}(std::this_thread::get_id());
+                search(*lane);
+            },
+            group);
+    }
+}
+
+void SearchHandle::start() {
+    pool = &ensure_pool_exists(config);
+    std::lock_guard<std::mutex> lock(mutex);
+    submit_lanes();
+}
+
+void SearchHandle::run() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active = 1;
+    }
+    search(*lanes[0]);
+}
+
+void SearchHandle::extend(std::chrono::milliseconds more) {
+    if (config.iterations > 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started.load(std::memory_order_relaxed) == 0) {
+        budget += more;
+        return;
+    }
+    auto now = clock_type::now().time_since_epoch().count();
+    auto ticks = std::chrono::duration_cast<clock_type::duration>(more).count();
+    if (active > 0) {
+        deadline = std::max(deadline.load(), now) + ticks;
+        return;
+    }
+    if (!pool || stop_source.stop_requested()) {
+        return;
+    }
+    deadline = now + ticks;
+    submit_lanes();
+}
+
+void SearchHandle::stop() {
+    stop_source.request_stop();
+}
+
+void SearchHandle::wait() {
+    if (pool) {
+        pool->wait(group);
+    }
+}
+
+bool SearchHandle::wait_for(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return finished_cv.wait_for(lock, timeout, [this] {
+        return active == 0;
+    });
+}
+
+bool SearchHandle::finished() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return active == 0;
+}
+
+void SearchHandle::on_finished(std::function<void()> callback) {
+    finished_callback = std::move(callback);
+}
+
+uint64_t SearchHandle::reused_visits() const {
+    return reused;
+}
+
+SearchInfo SearchHandle::info() {
+    TraceScope trace("merge");
+    auto merge_start = clock_type::now();
+    SearchInfo info;
+    for (auto& lane : lanes) {
+        std::lock_guard<std::mutex> lock(lane->mutex);
+        info.visits += lane->visits;
+        for (auto& child : lane->children) {
+            auto it = std::find_if(info.children.begin(), info.children.end(), [&](ChildStats const& c) {
+                return c.move == child.move;
+            });
+            if (it == info.children.end()) {
+                info.children.push_back(child);
+            } else {
+                it->visits += child.visits;
+                it->total_score += child.total_score;
+            }
+        }
+    }
+    std::stable_sort(info.children.begin(), info.children.end(), [](ChildStats const& a, ChildStats const& b) {
+        return a.visits > b.visits;
+    });
+    info.merge_us = std::chrono::duration<double, std::micro>(clock_type::now() - merge_start).count();
+    auto start = started.load(std::memory_order_relaxed);
+    if (start != 0) {
+        info.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now().time_since_epoch() - clock_type::duration(start)).count();
+    }
+    info.finished = finished();
+    return info;
+}
+
+TreeStats SearchHandle::tree_stats(SearchInfo const& info) {
+    TreeStats stats;
+    // Nodes and the expanded ones among them at every depth
+    std::vector<uint64_t> depth_nodes;
+    std::vector<uint64_t> depth_children;
+    std::vector<uint64_t> depth_expanded;
+    uint64_t depth_sum = 0;
+    std::vector<std::pair<MCTSNode*, int>> stack;
+    for (auto& lane : lanes) {
+        uint64_t nodes = 0;
+        stack.push_back({lane->root.get(), 0});
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            nodes++;
+            depth_sum += depth;
+            stats.bytes += sizeof(MCTSNode) + node->children.capacity() * sizeof(std::unique_ptr<MCTSNode>) + node->game.players.capacity() * sizeof(Player);
+            if ((int)depth_nodes.size() <= depth) {
+                depth_nodes.resize(depth + 1);
+                depth_children.resize(depth + 1);
+                depth_expanded.resize(depth + 1);
+            }
+            depth_nodes[depth]++;
+            if (!node->children.empty()) {
+                depth_expanded[depth]++;
+                depth_children[depth] += node->children.size();
+            }
+            for (auto& child : node->children) {
+                stack.push_back({child.get(), depth + 1});
+            }
+        }
+        stats.nodes += nodes;
+        stats.nodes_per_thread.push_back(nodes);
+        stats.iterations += lane->iterations;
+    }
+    stats.max_depth = depth_nodes.size() - 1;
+    stats.average_depth = (double)depth_sum / stats.nodes;
+    for (size_t depth = 0; depth < depth_nodes.size(); depth++) {
+        stats.branching.push_back(depth_expanded[depth] ? (double)depth_children[depth] / depth_expanded[depth] : 0);
+    }
+    stats.iterations_per_sec = info.elapsed_ms > 0 ? stats.iterations * 1000.0 / info.elapsed_ms : 0;
+    for (auto& child : info.children) {
+        stats.root_visits.push_back(child.visits);
+    }
+    stats.merge_us = info.merge_us;
+    return stats;
+}
+
+template <typename T>
+static void write_array(std::ostringstream& oss, std::vector<T> const& values) {
+    oss << "[";
+    for (size_t i = 0; i < values.size(); i++) {
+        oss << (i ? ", " : "") << values[i];
+    }
+    oss << "]";
+}
+
+std::string TreeStats::to_json() const {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2);
+    oss << "{\"nodes\": " << nodes << ", \"nodes_per_thread\": ";
+    write_array(oss, nodes_per_thread);
+    oss << ", \"max_depth\": " << max_depth << ", \"average_depth\": " << average_depth << ", \"branching\": ";
+    write_array(oss, branching);
+    oss << ", \"bytes\": " << bytes << ", \"iterations\": " << iterations << ", \"iterations_per_sec\": " << iterations_per_sec << ", \"root_visits\": ";
+    write_array(oss, root_visits);
+    oss << ", \"merge_us\": " << merge_us << "}";
+    return oss.str();
+}
@@ -0,0 +1,132 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include "game.h"
+#include "mcts.h"
+#include "run.h"
+#include "scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+// Statistics of one root move, summed over the search threads
+struct ChildStats {
+    Move move;
+    uint64_t visits = 0;
+    uint64_t total_score = 0;
+
+    double average_score() const;
+};
+
+struct SearchInfo {
+    // Most visited first
+    std::vector<ChildStats> children;
+    uint64_t visits = 0;
+    int64_t elapsed_ms = 0;
+    bool finished = false;
+    // Time info() spent merging the threads' root statistics
+    double merge_us = 0;
+
+    std::optional<Move> best_move() const;
+    std::string to_string() const;
+};
+
+// Shape and size of the trees of a finished search
+struct TreeStats {
+    uint64_t nodes = 0;
+    std::vector<uint64_t> nodes_per_thread;
+    int max_depth = 0;
+    double average_depth = 0;
+    // Average children of the expanded nodes at each depth, from the root
+    std::vector<double> branching;
+    // Nodes with their child pointer arrays and players
+    uint64_t bytes = 0;
+    uint64_t iterations = 0;
+    double iterations_per_sec = 0;
+    // Visits of every root move, most visited first
+    std::vector<uint64_t> root_visits;
+    double merge_us = 0;
+
+    // One line of JSON
+    std::string to_json() const;
+};
+
+// A search that runs in the background on the shared pool. It can be queried
+// while it runs, extended, and stopped early; several handles may share the
+// pool. Each thread publishes its root statistics every few hundred
+// iterations, so info() never touches a tree that is being grown.
+class SearchHandle {
+public:
+    // Searches game for config.ms_per_move, or config.iterations when set, on
+    // config.threads threads, at most the pool's size, from the given
+    // per-thread roots when there is one for every thread
+    SearchHandle(Game const& game, Config const& config, std::vector<std::unique_ptr<MCTSNode>> roots = {});
+    ~SearchHandle();
+    SearchHandle(const SearchHandle&) = delete;
+    SearchHandle& operator=(const SearchHandle&) = delete;
+
+    // Submits one task per thread to the pool and returns
+    void start();
+    // Searches on the calling thread until done, for single-threaded
+    // searches that are already running on a pool worker
+    void run();
+    SearchInfo info();
+    // Pushes the deadline back, restarting the search if it already ended.
+    // Searches limited by iterations are not extended.
+    void extend(std::chrono::milliseconds more);
+    void stop();
+    void wait();
+    // Waits at most timeout, returns whether the search has finished
+    bool wait_for(std::chrono::milliseconds timeout);
+    bool finished();
+    // Visits the roots already had when they were handed in
+    uint64_t reused_visits() const;
+    // Runs on the thread that ends the search, set it before start()
+    void on_finished(std::function<void()> callback);
+    // Walks every thread's tree, only once the search has finished
+    TreeStats tree_stats(SearchInfo const& info);
+
+private:
+    struct alignas(64) Lane {
+        std::unique_ptr<MCTSNode> root;
+        std::mutex mutex;
+        std::vector<ChildStats> children;
+        uint64_t visits = 0;
+        // Only touched by the thread searching this lane
+        uint64_t iterations = 0;
+    };
+
+    void submit_lanes();
+    void search(Lane& lane);
+    void publish(Lane& lane);
+    bool should_stop(Lane const& lane);
+    // Starts the time budget when the first lane runs
+    void start_clock();
+
+    Config config;
+    std::vector<std::unique_ptr<Lane>> lanes;
+    uint64_t reused = 0;
+    // Both 0 until a lane first runs, so a search queued behind others on
+    // the pool doesn't spend its budget waiting
+    std::atomic<std::chrono::steady_clock::rep> started{0};
+    std::atomic<std::chrono::steady_clock::rep> deadline{0};
+    // Extended by extend() calls made before the clock starts
+    std::chrono::steady_clock::duration budget;
+    std::stop_source stop_source;
+    // Lanes still searching; exits and extensions are decided under the mutex
+    int active = 0;
+    std::mutex mutex;
+    std::condition_variable finished_cv;
+    std::function<void()> finished_callback;
+    Scheduler* pool = nullptr;
+    TaskGroup group;
+};
+
+#endif // SEARCH_HPP
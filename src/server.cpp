@@ -0,0 +1,359 @@
+#include "server.h"
+#include "protocol.h"
+#include "scheduler.h"
+#include "search.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using clock_type = std::chrono::steady_clock;
+
+// Searches running at once per pool worker, the rest wait in the queue.
+// Searches beyond one per worker wait in the pool's deques, but their time
+// budget only starts when they first run.
+constexpr int SEARCHES_PER_WORKER = 2;
+// Longest request line a session may send
+constexpr size_t MAX_REQUEST = 1 << 16;
+
+// Request latencies in log spaced buckets, eight per doubling from a
+// microsecond, so a long running server keeps constant memory and stats
+// reads percentiles in one pass. Percentiles are a bucket's upper bound,
+// within 9% of the exact value.
+struct LatencyHistogram {
+    static constexpr double MIN_MS = 0.001;
+    static constexpr int BUCKETS_PER_DOUBLING = 8;
+    std::array<int64_t, 32 * BUCKETS_PER_DOUBLING> buckets = {};
+    int64_t count = 0;
+    double sum = 0;
+    double max = 0;
+
+    void add(double ms) {
+        int bucket = ms <= MIN_MS ? 0 : (int)std::ceil(std::log2(ms / MIN_MS) * BUCKETS_PER_DOUBLING);
+        buckets[std::min<int>(bucket, buckets.size() - 1)]++;
+        count++;
+        sum += ms;
+        max = std::max(max, ms);
+    }
+
+    double mean() const {
+        return count ? sum / count : 0.0;
+    }
+
+    double percentile(double p) const {
+        int64_t rank = std::min<int64_t>(count - 1, (int64_t)(p * count));
+        for (size_t i = 0; i < buckets.size(); i++) {
+            rank -= buckets[i];
+            if (rank < 0) {
+                return std::min(max, MIN_MS * std::exp2((double)i / BUCKETS_PER_DOUBLING));
+            }
+        }
+        return 0.0;
+    }
+};
+
+struct Request {
+    std::string line;
+    clock_type::time_point received;
+};
+
+// Where the poll loop resumes a session
+enum class SessionState { Idle, Queued, Searching, Closing };
+
+struct Session {
+    int fd = -1;
+    SessionState state = SessionState::Idle;
+    bool hung_up = false;
+    std::string input;
+    std::string output;
+    // Received but not started; a session's requests are answered in order
+    std::deque<Request> requests;
+    Request current;
+    std::unique_ptr<SearchHandle> search;
+};
+
+struct Server {
+    Config config;
+    Scheduler* pool = nullptr;
+    int listen_fd = -1;
+    int wake_fd = -1;
+    bool shutting_down = false;
+    std::list<Session> sessions;
+    std::deque<Session*> queue;
+    int running = 0;
+
+    int64_t answered = 0;
+    int64_t errors = 0;
+    int max_depth = 0;
+    LatencyHistogram latencies;
+
+    std::string stats();
+    void read_input(Session& session);
+    void write_output(Session& session);
+    void step(Session& session);
+    bool start_request(Session& session, Request const& request);
+    void finish_search(Session& session);
+    void start_queued();
+};
+
+std::string Server::stats() {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3);
+    oss << "stats requests " << answered << " errors " << errors << " sessions " << sessions.size() << " running " << running << " queued " << queue.size() << " max_depth " << max_depth
+        << " latency_ms mean " << latencies.mean() << " p50 " << latencies.percentile(0.5) << " p99 " << latencies.percentile(0.99) << " max " << latencies.max;
+    return oss.str();
+}
+
+void Server::read_input(Session& session) {
+    char buffer[4096];
+    while (true) {
+        ssize_t n = recv(session.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            session.input.append(buffer, n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            session.hung_up = true;
+        }
+        break;
+    }
+
+    size_t newline;
+    while ((newline = session.input.find('\n')) != std::string::npos) {
+        session.requests.push_back({session.input.substr(0, newline), clock_type::now()});
+        session.input.erase(0, newline + 1);
+    }
+    if (session.input.size() > MAX_REQUEST) {
+        session.hung_up = true;
+    }
+}
+
+void Server::write_output(Session& session) {
+    while (!session.output.empty()) {
+        ssize_t n = send(session.fd, session.output.data(), session.output.size(), MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                session.hung_up = true;
+            }
+            return;
+        }
+        session.output.erase(0, n);
+    }
+}
+
+// Returns whether a search was queued for the request
+bool Server::start_request(Session& session, Request const& request) {
+    Config search_config = config;
+    search_config.threads = 1;
+    search_config.ponder = false;
+
+    std::istringstream iss(request.line);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (iss >> token) {
+        tokens.push_back(token);
+    }
+    size_t i = 0;
+    for (; i + 1 < tokens.size(); i += 2) {
+        if (tokens[i] == "ms") {
+            search_config.ms_per_move = std::max(1, std::stoi(tokens[i + 1]));
+            search_config.iterations = 0;
+        } else if (tokens[i] == "iterations") {
+            search_config.iterations = std::max<int64_t>(1, std::stoll(tokens[i + 1]));
+        } else if (tokens[i] == "threads") {
+            search_config.threads = std::clamp(std::stoi(tokens[i + 1]), 1, pool->size());
+        } else {
+            break;
+        }
+    }
+    std::string fields;
+    for (; i < tokens.size(); i++) {
+        fields += tokens[i] + " ";
+    }
+    std::istringstream position(fields);
+    Game game = parse_position(position);
+    if (game.is_terminal()) {
+        session.output += "bestmove none\n";
+        return false;
+    }
+
+    session.current = request;
+    session.search = std::make_unique<SearchHandle>(game, search_config);
+    int fd = wake_fd;
+    session.search->on_finished([fd] {
+        uint64_t one = 1;
+        (void)!write(fd, &one, sizeof(one));
+    });
+    session.state = SessionState::Queued;
+    queue.push_back(&session);
+    max_depth = std::max(max_depth, running + (int)queue.size());
+    return true;
+}
+
+// Handles the session's requests until one needs a search
+void Server::step(Session& session) {
+    while (session.state == SessionState::Idle && !session.requests.empty()) {
+        Request request = session.requests.front();
+        session.requests.pop_front();
+        std::istringstream iss(request.line);
+        std::string cmd;
+        if (!(iss >> cmd)) {
+            continue;
+        }
+        if (cmd == "stats") {
+            session.output += stats() + "\n";
+        } else if (cmd == "quit") {
+            session.state = SessionState::Closing;
+        } else if (cmd == "shutdown") {
+            shutting_down = true;
+            session.output += "ok\n";
+        } else {
+            try {
+                start_request(session, request);
+            } catch (std::exception const& e) {
+                errors++;
+                session.output += std::string("error ") + e.what() + "\n";
+            }
+        }
+    }
+}
+
+void Server::start_queued() {
+    while (running < SEARCHES_PER_WORKER * pool->size() && !queue.empty()) {
+        Session& session = *queue.front();
+        queue.pop_front();
+        session.state = SessionState::Searching;
+        session.search->start();
+        running++;
+    }
+}
+
+void Server::finish_search(Session& session) {
+    session.search->wait();
+    SearchInfo info = session.search->info();
+    session.search.reset();
+    session.state = SessionState::Idle;
+    running--;
+
+    double latency = std::chrono::duration<double, std::milli>(clock_type::now() - session.current.received).count();
+    latencies.add(latency);
+    answered++;
+
+    std::ostringstream oss;
+    for (ChildStats child : info.children) {
+        oss << "child " << child.visits << " " << std::fixed << std::setprecision(3) << child.average_score() << " " << child.move.to_string() << "\n";
+    }
+    oss << "bestmove " << info.best_move().value().to_string() << " visits " << info.visits << " time " << info.elapsed_ms << " latency " << std::fixed << std::setprecision(3) << latency << "\n";
+    session.output += oss.str();
+}
+
+void run_server(Config config, const std::string& socket_path) {
+    Server server;
+    server.config = config;
+    server.pool = &ensure_pool_exists(config);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: socket path too long" << std::endl;
+        return;
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+    unlink(socket_path.c_str());
+
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0 || bind(server.listen_fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(server.listen_fd, 128) < 0) {
+        std::cerr << "Error: cannot listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+    server.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    std::cout << "Listening on " << socket_path << " with " << server.pool->size() << " workers" << std::endl;
+
+    std::vector<pollfd> fds;
+    std::vector<Session*> polled;
+    while (!server.shutting_down || server.running > 0 || !server.queue.empty()) {
+        fds.clear();
+        polled.clear();
+        fds.push_back({server.wake_fd, POLLIN, 0});
+        if (!server.shutting_down) {
+            fds.push_back({server.listen_fd, POLLIN, 0});
+        }
+        for (Session& session : server.sessions) {
+            if (session.hung_up) {
+                continue;
+            }
+            short events = POLLIN;
+            if (!session.output.empty()) {
+                events |= POLLOUT;
+            }
+            fds.push_back({session.fd, events, 0});
+            polled.push_back(&session);
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) {
+            break;
+        }
+
+        uint64_t wakeups;
+        (void)!read(server.wake_fd, &wakeups, sizeof(wakeups));
+        if (!server.shutting_down && fds[1].revents & POLLIN) {
+            int fd;
+            while ((fd = accept4(server.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                Session session;
+                session.fd = fd;
+                server.sessions.push_back(std::move(session));
+            }
+        }
+        size_t first_session = server.shutting_down ? 1 : 2;
+        for (size_t i = 0; i < polled.size(); i++) {
+            short revents = fds[first_session + i].revents;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                server.read_input(*polled[i]);
+            }
+        }
+
+        for (Session& session : server.sessions) {
+            if (session.state == SessionState::Searching && session.search->finished()) {
+                server.finish_search(session);
+            }
+            if (session.hung_up && session.search) {
+                session.search->stop();
+            }
+            server.step(session);
+            server.write_output(session);
+        }
+        server.start_queued();
+
+        for (auto it = server.sessions.begin(); it != server.sessions.end();) {
+            bool done = it->state == SessionState::Closing && it->output.empty();
+            if ((it->hung_up && it->state != SessionState::Searching) || done) {
+                if (it->state == SessionState::Queued) {
+                    server.queue.erase(std::find(server.queue.begin(), server.queue.end(), &*it));
+                }
+                close(it->fd);
+                it = server.sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (Session& session : server.sessions) {
+        server.write_output(session);
+        close(session.fd);
+    }
+    close(server.listen_fd);
+    close(server.wake_fd);
+    unlink(socket_path.c_str());
+    std::cout << server.stats() << std::endl;
+}
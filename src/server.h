@@ -0,0 +1,20 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "run.h"
+#include <string>
+
+// Serves analysis requests on a Unix domain socket until a client sends
+// "shutdown". Every client connection is a session; a request is one line
+//   [ms <n>] [iterations <n>] [threads <n>] <position fields>
+// with the position fields of the protocol's position command, answered by
+// the root children ("child <visits> <average> <move>") and a final
+// "bestmove <move> visits <n> time <ms> latency <ms>" line. "stats" reports
+// the request latency and queue depth, "quit" closes the session.
+//
+// One thread polls all sockets and steps every session's state machine;
+// searches run on the shared pool and wake the poll loop when they end. At
+// most two searches per pool worker run at once, later requests queue.
+void run_server(Config config, const std::string& socket_path);
+
+#endif // SERVER_HPP
@@ -0,0 +1,164 @@
+#include "shared_memory.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+enum SegmentState : uint32_t { Building = 0, Ready = 1, Abandoned = 2 };
+
+// Precedes the payload; a fresh segment is zero, i.e. Building
+struct alignas(64) SegmentHeader {
+    std::atomic<uint32_t> state;
+    // Set by the creator right after mapping, so attaching processes can tell
+    // a slow creator from a dead one
+    std::atomic<int32_t> creator;
+    uint64_t bytes;
+};
+
+// How long an attaching process waits for the creator to fill a segment
+constexpr auto ATTACH_TIMEOUT = std::chrono::seconds(120);
+// A live creator sizes the segment and records its pid within microseconds
+constexpr auto CREATOR_GRACE = std::chrono::seconds(1);
+// Times a stale segment is removed and opened again before giving up
+constexpr int OPEN_ATTEMPTS = 3;
+
+static bool process_alive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+void* map_anonymous(size_t bytes) {
+    void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return data == MAP_FAILED ? nullptr : data;
+}
+
+const void* map_file_read_only(const std::string& path, size_t& bytes) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        bytes = st.st_size;
+        data = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return data == MAP_FAILED ? nullptr : data;
+}
+
+SharedSegment::Role SharedSegment::open(const std::string& segment_name, size_t bytes) {
+    name = segment_name;
+    for (int attempt = 0; attempt < OPEN_ATTEMPTS; attempt++) {
+        if (std::optional<Role> role = open_once(bytes)) {
+            return *role;
+        }
+        // The creator died before marking the segment ready; a process that
+        // attached in time keeps its mapping, later ones get a fresh segment
+        std::cerr << "Removing shared segment " << name << " left behind by a dead process" << std::endl;
+        shm_unlink(name.c_str());
+    }
+    return Role::Failed;
+}
+
+std::optional<SharedSegment::Role> SharedSegment::open_once(size_t bytes) {
+    size_t total = sizeof(SegmentHeader) + bytes;
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd >= 0) {
+        // A new tmpfs object is sparse, only the pages written use memory
+        if (ftruncate(fd, total) == 0) {
+            base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (base == nullptr || base == MAP_FAILED) {
+            base = nullptr;
+            shm_unlink(name.c_str());
+            return Role::Failed;
+        }
+        auto* header = static_cast<SegmentHeader*>(base);
+        header->bytes = bytes;
+        header->creator.store(getpid(), std::memory_order_release);
+        return Role::Creator;
+    }
+    if (errno != EEXIST) {
+        return Role::Failed;
+    }
+
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        // Removed between the two opens, try again
+        return errno == ENOENT ? std::nullopt : std::optional(Role::Failed);
+    }
+    // The creator may not have sized the segment yet
+    auto start = std::chrono::steady_clock::now();
+    struct stat st = {};
+    while (fstat(fd, &st) == 0 && (size_t)st.st_size < total && std::chrono::steady_clock::now() < start + CREATOR_GRACE) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return std::nullopt;
+    }
+    if ((size_t)st.st_size == total) {
+        base = mmap(nullptr, total, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == nullptr || base == MAP_FAILED) {
+        base = nullptr;
+        return Role::Failed;
+    }
+
+    auto* header = static_cast<SegmentHeader*>(base);
+    bool stale = false;
+    while (header->state.load(std::memory_order_acquire) == Building && std::chrono::steady_clock::now() < start + ATTACH_TIMEOUT) {
+        pid_t creator = header->creator.load(std::memory_order_acquire);
+        if (creator ? !process_alive(creator) : std::chrono::steady_clock::now() > start + CREATOR_GRACE) {
+            stale = true;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (stale || header->state.load(std::memory_order_acquire) != Ready || header->bytes != bytes) {
+        if (!stale) {
+            std::cerr << "Shared segment " << name << " is not usable, remove /dev/shm" << name << " to rebuild it" << std::endl;
+        }
+        munmap(base, total);
+        base = nullptr;
+        return stale ? std::nullopt : std::optional(Role::Failed);
+    }
+    return Role::Attached;
+}
+
+void unlink_other_segments(const std::string& prefix, const std::string& keep) {
+    // Linux keeps POSIX shared memory objects in /dev/shm, named without the
+    // leading slash
+    std::error_code ec;
+    for (auto const& entry : std::filesystem::directory_iterator("/dev/shm", ec)) {
+        std::string segment = entry.path().filename().string();
+        segment.insert(segment.begin(), '/');
+        if (segment.starts_with(prefix) && segment != keep) {
+            shm_unlink(segment.c_str());
+        }
+    }
+}
+
+void* SharedSegment::data() const {
+    return static_cast<char*>(base) + sizeof(SegmentHeader);
+}
+
+void SharedSegment::mark_ready() {
+    static_cast<SegmentHeader*>(base)->state.store(Ready, std::memory_order_release);
+}
+
+void SharedSegment::abandon() {
+    static_cast<SegmentHeader*>(base)->state.store(Abandoned, std::memory_order_release);
+    shm_unlink(name.c_str());
+}
@@ -0,0 +1,44 @@
+#ifndef SHARED_MEMORY_HPP
+#define SHARED_MEMORY_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// Private zero-filled memory whose pages are only allocated once touched,
+// nullptr on failure
+void* map_anonymous(size_t bytes);
+
+// Maps a whole file read-only and shared, so every process reading it uses
+// the same page cache pages. Returns nullptr when the file can't be mapped.
+const void* map_file_read_only(const std::string& path, size_t& bytes);
+
+// A named POSIX shared memory segment. The first process to open a name
+// creates and fills it; later processes wait until it is marked ready and
+// map it read-only. Segments outlive the processes, so later runs attach
+// instantly (remove /dev/shm/<name> to rebuild one). A segment whose creator
+// died before marking it ready is removed and created again.
+class SharedSegment {
+public:
+    enum class Role { Creator, Attached, Failed };
+
+    Role open(const std::string& name, size_t bytes);
+    // Payload, zero-filled for the creator
+    void* data() const;
+    void mark_ready();
+    // Called by a creator that couldn't fill the segment
+    void abandon();
+
+private:
+    // nullopt when the segment was left behind by a dead creator
+    std::optional<Role> open_once(size_t bytes);
+
+    std::string name;
+    void* base = nullptr;
+};
+
+// Removes the segments whose name starts with prefix, except keep. Processes
+// that mapped them keep their mappings.
+void unlink_other_segments(const std::string& prefix, const std::string& keep);
+
+#endif // SHARED_MEMORY_HPP
@@ -0,0 +1,96 @@
+#include "sweep.h"
+#include "corpus.h"
+#include "match.h"
+#include "mcts.h"
+#include "search.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+// The reference search gets this many times the longest budget
+constexpr int REFERENCE_FACTOR = 4;
+
+struct SweepResult {
+    uint64_t visits = 0;
+    // Measured around every search, SearchInfo::elapsed_ms is whole ms
+    double elapsed_us = 0;
+    double merge_us = 0;
+    int agreements = 0;
+    // Over the moves the reference tried, the others are counted apart
+    double loss = 0;
+    int untried = 0;
+};
+
+void run_sweep(Config config, SweepOptions const& options) {
+    int max_threads = std::clamp(config.threads, 1, ensure_pool_exists(config).size());
+    config.ponder = false;
+    config.iterations = 0;
+
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    std::vector<CorpusEntry> corpus;
+    if (!options.corpus.empty()) {
+        try {
+            corpus = read_corpus(options.corpus);
+        } catch (std::exception const& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return;
+        }
+        std::cout << "Loaded " << corpus.size() << " positions from " << options.corpus << std::endl;
+    } else {
+        std::cout << "Sampling " << options.positions << " positions from seed " << options.seed << "..." << std::endl;
+        Config reference_config = config;
+        reference_config.threads = max_threads;
+        reference_config.ms_per_move = REFERENCE_FACTOR * *std::max_element(options.ms_per_move.begin(), options.ms_per_move.end());
+        std::cout << "Reference searches: " << max_threads << " threads, " << reference_config.ms_per_move << " ms" << std::endl;
+        for (Game& game : seeded_positions(options.seed, options.positions)) {
+            SearchInfo info;
+            run_mcts(game, reference_config, {}, &info);
+            corpus.push_back({game, std::move(info.children)});
+        }
+    }
+    if (corpus.empty()) {
+        return;
+    }
+
+    std::cout << std::fixed;
+    for (int ms : options.ms_per_move) {
+        double single_thread_ips = 0;
+        for (int threads : thread_counts) {
+            Config search_config = config;
+            search_config.threads = threads;
+            search_config.ms_per_move = ms;
+
+            SweepResult result;
+            for (CorpusEntry& entry : corpus) {
+                SearchInfo info;
+                auto start = std::chrono::steady_clock::now();
+                Move move = run_mcts(entry.game, search_config, {}, &info);
+                result.elapsed_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+                result.visits += info.visits;
+                result.merge_us += info.merge_us;
+                result.agreements += move == entry.reference.front().move;
+                if (std::optional<double> loss = reference_loss(entry, move)) {
+                    result.loss += *loss;
+                } else {
+                    result.untried++;
+                }
+            }
+
+            double ips = result.elapsed_us > 0 ? result.visits * 1e6 / result.elapsed_us : 0;
+            if (threads == 1) {
+                single_thread_ips = ips;
+            }
+            double efficiency = single_thread_ips > 0 ? ips / (threads * single_thread_ips) : 0;
+            int tried = corpus.size() - result.untried;
+            std::cout << "sweep ms " << ms << " threads " << threads << std::setprecision(0) << " ips " << ips << std::setprecision(3) << " efficiency " << efficiency << " merge_us "
+                      << result.merge_us / corpus.size() << " merge_pct " << (result.elapsed_us > 0 ? 100 * result.merge_us / result.elapsed_us : 0) << " agreement "
+                      << (double)result.agreements / corpus.size() << " loss " << (tried ? result.loss / tried : 0) << " untried " << result.untried << std::endl;
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include "run.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SweepOptions {
+    std::vector<int> ms_per_move = {5, 20, 50};
+    int positions = 24;
+    uint64_t seed = 1;
+    // Positions and reference moves to use instead of sampling them
+    std::string corpus;
+};
+
+// Searches the same positions with 1, 2, 4, ... up to config.threads
+// threads for every time budget, and prints one line per combination:
+// iterations per second, parallel efficiency against one thread, the time
+// spent merging the threads' root statistics, how often the move agrees
+// with the reference move, the mean expected-score loss against it over
+// the moves the reference tried, and how many moves it never tried. The
+// positions and references come from options.corpus, or else are sampled
+// from seeded games and searched with all threads for four times the
+// longest budget.
+void run_sweep(Config config, SweepOptions const& options);
+
+#endif // SWEEP_HPP
@@ -0,0 +1,91 @@
+#include "trace.h"
+#include "scheduler.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Events kept per thread
+constexpr size_t TRACE_CAPACITY = 1 << 16;
+
+std::atomic<bool> tracing = false;
+
+struct TraceEvent {
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+struct TraceBuffer {
+    std::string thread_name;
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(TRACE_CAPACITY);
+    // Events ever recorded, the oldest are overwritten
+    std::atomic<uint64_t> count = 0;
+};
+
+static std::string trace_path;
+static std::chrono::steady_clock::time_point trace_start;
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+static TraceBuffer* register_buffer() {
+    auto buffer = std::make_unique<TraceBuffer>();
+    int worker = Scheduler::worker_index();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer->thread_name = worker >= 0 ? "worker " + std::to_string(worker) : "thread " + std::to_string(buffers.size());
+    buffers.push_back(std::move(buffer));
+    return buffers.back().get();
+}
+
+uint64_t TraceScope::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_start).count();
+}
+
+void TraceScope::record(const char* name, uint64_t begin, uint64_t end) {
+    thread_local TraceBuffer* buffer = register_buffer();
+    uint64_t count = buffer->count.load(std::memory_order_relaxed);
+    buffer->events[count % TRACE_CAPACITY] = {name, begin, end};
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void start_tracing(const std::string& path) {
+    if (tracing) {
+        return;
+    }
+    trace_path = path;
+    trace_start = std::chrono::steady_clock::now();
+    tracing = true;
+}
+
+void write_trace() {
+    if (!tracing.exchange(false)) {
+        return;
+    }
+    std::ofstream ofs(trace_path);
+    if (!ofs) {
+        std::cerr << "Error: cannot write trace " << trace_path << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    // Microseconds with nanosecond precision
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    uint64_t written = 0;
+    for (size_t tid = 0; tid < buffers.size(); tid++) {
+        TraceBuffer& buffer = *buffers[tid];
+        ofs << (tid ? ",\n" : "") << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << tid << ", \"args\": {\"name\": \"" << buffer.thread_name << "\"}}";
+        uint64_t count = buffer.count.load(std::memory_order_acquire);
+        uint64_t first = count > TRACE_CAPACITY ? count - TRACE_CAPACITY : 0;
+        for (uint64_t i = first; i < count; i++) {
+            TraceEvent const& event = buffer.events[i % TRACE_CAPACITY];
+            ofs << ",\n{\"ph\": \"X\", \"name\": \"" << event.name << "\", \"pid\": 1, \"tid\": " << tid << ", \"ts\": " << event.begin / 1000.0 << ", \"dur\": " << (event.end - event.begin) / 1000.0
+                << "}";
+            written++;
+        }
+    }
+    ofs << "\n]}\n";
+    std::cerr << "Wrote " << written << " trace events of " << buffers.size() << " threads to " << trace_path << std::endl;
+}
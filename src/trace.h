@@ -0,0 +1,40 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline of what every thread did, written as Chrome trace-event JSON
+// (chrome://tracing, ui.perfetto.dev). Each thread records into a ring
+// buffer of its own, so only the most recent events of a long run are kept.
+extern std::atomic<bool> tracing;
+
+// Starts recording; write_trace writes the events to path and stops. It must
+// only run once no other thread records, main calls it after joining the pool.
+void start_tracing(const std::string& path);
+void write_trace();
+
+// Records the time from construction to destruction as an event; event must
+// be a string literal. Costs one load when not tracing.
+class TraceScope {
+public:
+    explicit TraceScope(const char* event)
+        : name(tracing.load(std::memory_order_relaxed) ? event : nullptr), begin(name ? now() : 0) {}
+    ~TraceScope() {
+        if (name) {
+            record(name, begin, now());
+        }
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    static uint64_t now();
+    static void record(const char* name, uint64_t begin, uint64_t end);
+
+    const char* name;
+    uint64_t begin;
+};
+
+#endif // TRACE_HPP
@@ -21,6 +21,11 @@ uint8_t fast_rand(uint8_t max) {
     return ((uint16_t)rng() * max) >> 8;
 }
 
+uint32_t fast_rand_u32() {
+    rng();
+    return rng_state;
+}
+
 uint8_t random_set_bit_u32(uint32_t x) {
     uint32_t start = rng() & 31;
     uint32_t y = (x >> start) | (x << (32 - start));
@@ -41,21 +46,12 @@ uint32_t parse_uint(const std::string& s) {
 }
 
 std::optional<uint8_t> next_valid_category(DiceLookup& lookup, uint32_t mask, uint8_t start) {
-    // Iterate through the categories vector starting from 'start'
-    for (uint8_t i = start; i < lookup.categories.size(); ++i) {
-        // Get the specific category (e.g., Category::Ones)
-        int category_id = (int)lookup.categories[i].category;
-
-        // Check if this bit is NOT set in the mask
-        // mask represents already scored categories
-        if (mask & (1 << category_id)) {
-            return i; // Found the next available category index
-        }
+    // Positions at or after 'start' whose category is set in the mask
+    uint32_t valid = category_positions(lookup.index, mask) >> start << start;
+    if (valid == 0) {
+        return std::nullopt;
     }
-
-    // Return a sentinel value (like the size of the vector) 
-    // to indicate no valid category was found.
-    return std::nullopt;
+    return __builtin_ctz(valid);
 }
 
 Category worst_category(uint32_t mask) {
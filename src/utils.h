@@ -7,6 +7,7 @@
 #include <string>
 
 uint8_t fast_rand(uint8_t max);
+uint32_t fast_rand_u32();
 uint8_t random_set_bit_u32(uint32_t x);
 uint8_t random_set_bit_u64(uint64_t x);
 uint32_t parse_uint(const std::string& s);
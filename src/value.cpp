@@ -0,0 +1,116 @@
+#include "value.h"
+#include "game.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+const std::string VALUE_FILENAME = "value_table.bin";
+
+ValueTable value_table;
+static bool loaded = false;
+
+static void save_value_table(const std::string& filename) {
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        std::cerr << "Could not open file for writing: " << filename << std::endl;
+        return;
+    }
+    size_t table_size = sizeof(ValueTable);
+    ofs.write(reinterpret_cast<const char*>(&table_size), sizeof(table_size));
+    ofs.write(reinterpret_cast<const char*>(&value_table), sizeof(ValueTable));
+    std::cout << "Value table saved to " << filename << std::endl;
+}
+
+static bool load_value_table(const std::string& filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return false;
+
+    size_t table_size;
+    ifs.read(reinterpret_cast<char*>(&table_size), sizeof(table_size));
+    if (!ifs || table_size != sizeof(ValueTable))
+        return false;
+    ifs.read(reinterpret_cast<char*>(&value_table), sizeof(ValueTable));
+    return (bool)ifs;
+}
+
+bool init_value_table() {
+    loaded = load_value_table(VALUE_FILENAME);
+    if (loaded) {
+        std::cout << "Loaded value table from cache." << std::endl;
+    }
+    return loaded;
+}
+
+bool value_table_loaded() {
+    return loaded;
+}
+
+float evaluate_state(uint32_t open, int bonus_progress, int rerolls) {
+    if (open == 0) {
+        return 0;
+    }
+    int progress = std::min<int>(bonus_progress, VALUE_BONUS_STATES - 1);
+    rerolls = std::min<int>(rerolls, VALUE_REROLL_STATES - 1);
+    return value_table.lower[open >> 6] + value_table.upper[open & 63][progress] + value_table.rerolls[rerolls];
+}
+
+float evaluate_player(const Player& player) {
+    return evaluate_state(player.scored_mask, player.bonus_progress, player.rerolls);
+}
+
+// Fits the tables with SGD on the remaining score of every turn of full
+// playouts, so the estimate matches what Game::playout would have returned.
+void train_value_table(int games) {
+    struct Sample {
+        Player player;
+        int score;
+    };
+    std::array<Sample, (int)Category::Count> samples;
+
+    value_table = ValueTable();
+    double abs_error = 0;
+    int error_count = 0;
+
+    for (int g = 0; g < games; g++) {
+        float rate = 0.01f * (1.0f - (float)g / games) + 0.0005f;
+
+        Game game = Game(1);
+        int n = 0;
+        while (!game.is_terminal()) {
+            samples[n] = {game.player(), game.player().total_score()};
+            n++;
+            game.playout(game.rounds + 1);
+        }
+        int final_score = game.players[0].total_score();
+
+        for (int i = 0; i < n; i++) {
+            Player& player = samples[i].player;
+            uint32_t open = player.scored_mask;
+            int progress = std::min<int>(player.bonus_progress, VALUE_BONUS_STATES - 1);
+            int rerolls = std::min<int>(player.rerolls, VALUE_REROLL_STATES - 1);
+
+            float& lower = value_table.lower[open >> 6];
+            float& upper = value_table.upper[open & 63][progress];
+            float& reroll = value_table.rerolls[rerolls];
+
+            float error = (float)(final_score - samples[i].score) - (lower + upper + reroll);
+            lower += rate * error;
+            upper += rate * error;
+            reroll += rate * error;
+
+            abs_error += std::abs(error);
+            error_count++;
+        }
+
+        if ((g + 1) % 100000 == 0 || g + 1 == games) {
+            std::cout << "Trained " << g + 1 << " games, mean abs error: " << abs_error / error_count << std::endl;
+            abs_error = 0;
+            error_count = 0;
+        }
+    }
+
+    loaded = true;
+    save_value_table(VALUE_FILENAME);
+}
@@ -0,0 +1,30 @@
+#ifndef VALUE_HPP
+#define VALUE_HPP
+
+#include "game.h"
+#include <array>
+#include <cstdint>
+
+// Bonus progress is clamped to 75 (bonus reached) and saved rerolls to 8.
+constexpr int VALUE_BONUS_STATES = 76;
+constexpr int VALUE_REROLL_STATES = 9;
+
+// Learned estimate of the points a player still collects from a state. The
+// estimate is additive over three tables so a lookup is three loads:
+//   lower[open lower categories] + upper[open upper categories][bonus progress] + rerolls[saved rerolls]
+// The upper table includes the expected bonus.
+struct ValueTable {
+    std::array<float, 1 << 14> lower{};
+    std::array<std::array<float, VALUE_BONUS_STATES>, 1 << 6> upper{};
+    std::array<float, VALUE_REROLL_STATES> rerolls{};
+};
+
+extern ValueTable value_table;
+
+bool init_value_table();
+bool value_table_loaded();
+void train_value_table(int games);
+float evaluate_state(uint32_t open, int bonus_progress, int rerolls);
+float evaluate_player(const Player& player);
+
+#endif // VALUE_HPP